@@ -0,0 +1,73 @@
+// Throughput and accuracy of sigmoid and tanh for every accuracy tier on
+// every instruction set the cpu has. The errors are against the exact
+// functions (in double), the relative one where the result is not tiny.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "simd/NNSimd.h"
+
+// millions of floats per second of f over in
+template <typename F>
+static double throughput(const std::vector<float>& in, std::vector<float>& out, F f) {
+    using clock = std::chrono::steady_clock;
+    size_t done = 0;
+    auto start = clock::now();
+    std::chrono::duration<double> elapsed{};
+    while (elapsed.count() < 0.2) {
+        for (int i = 0; i < 16; ++i) f(in.data(), out.data(), in.size());
+        done += 16 * in.size();
+        elapsed = clock::now() - start;
+    }
+    return done / elapsed.count() / 1e6;
+}
+
+static void errors(const std::vector<float>& out, const std::vector<double>& exact,
+                   double& absolute, double& relative) {
+    absolute = relative = 0;
+    for (size_t i = 0; i < out.size(); ++i) {
+        double diff = std::fabs(out[i] - exact[i]);
+        absolute = std::max(absolute, diff);
+        if (std::fabs(exact[i]) > 1e-30) relative = std::max(relative, diff / std::fabs(exact[i]));
+    }
+}
+
+int main() {
+    // a layer worth of values in the range activations usually see
+    std::vector<float> timed(16384);
+    for (size_t i = 0; i < timed.size(); ++i) timed[i] = -8.0f + 16.0f * i / timed.size();
+    std::vector<float> x;
+    for (float v = -40.0f; v <= 40.0f; v += 1.0f / 1024) x.push_back(v);
+    std::vector<double> exact_sigmoid(x.size()), exact_tanh(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        exact_sigmoid[i] = 1.0 / (1.0 + std::exp(-double(x[i])));
+        exact_tanh[i] = std::tanh(double(x[i]));
+    }
+
+    const char* tier_names[] = {"Precise", "Fast", "Fastest"};
+    std::printf("%-8s %-8s %-8s %12s %12s %12s\n", "level", "tier", "function", "Mfloat/s", "max abs", "max rel");
+    for (NNSimdLevel level : {NNSimdLevel::Scalar, NNSimdLevel::SSE42, NNSimdLevel::AVX2, NNSimdLevel::AVX512}) {
+        setSimdLevel(level);
+        if (getSimdLevel() != level) continue;
+        const NNSimdKernels& kernels = simd();
+        std::vector<float> out(std::max(x.size(), timed.size()));
+        for (size_t tier = 0; tier < activation_accuracy_tiers; ++tier) {
+            double absolute, relative;
+            auto sigmoid = [&](const float* in, float* o, size_t n) { kernels.sigmoid[tier](in, o, n, 1.0f); };
+            double speed = throughput(timed, out, sigmoid);
+            sigmoid(x.data(), out.data(), x.size());
+            errors(out, exact_sigmoid, absolute, relative);
+            std::printf("%-8s %-8s %-8s %12.0f %12.3g %12.3g\n", getSimdLevelName(level), tier_names[tier],
+                        "sigmoid", speed, absolute, relative);
+
+            auto tanh = [&](const float* in, float* o, size_t n) { kernels.tanh[tier](in, o, n); };
+            speed = throughput(timed, out, tanh);
+            tanh(x.data(), out.data(), x.size());
+            errors(out, exact_tanh, absolute, relative);
+            std::printf("%-8s %-8s %-8s %12.0f %12.3g %12.3g\n", getSimdLevelName(level), tier_names[tier],
+                        "tanh", speed, absolute, relative);
+        }
+    }
+}
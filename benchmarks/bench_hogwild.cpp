@@ -0,0 +1,99 @@
+// Time to a target error of asynchronous (hogwild) training against the
+// synchronous data-parallel one, both plain SGD with the same learning rate
+// on the same network, data and threads. Hogwild takes more epochs (its
+// steps race and see stale weights), the question is whether its cheaper
+// epochs (no reduction, no waiting) make up for it.
+//   bench_hogwild [threads] [target error per sample] [learning rate]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#include "NNTeacher.h"
+
+// stops once the error per sample of the last epoch is below target,
+// or after max_epochs
+class TargetErrorTerminator : public NNTerminator {
+public:
+    TargetErrorTerminator(float target, size_t samples, size_t max_epochs) :
+        target{target}, samples{samples}, max_epochs{max_epochs} {}
+
+    bool shouldFinish(float error) override {
+        last_error = error / samples;
+        return last_error < target || epochs++ == max_epochs;
+    }
+
+    float target;
+    size_t samples;
+    size_t max_epochs;
+    size_t epochs = 0;
+    float last_error = INFINITY;
+};
+
+static Dataset makeData(size_t n) {
+    Dataset d(n, 4, 2);
+    for (size_t i = 0; i < n; ++i) {
+        auto row = d[i];
+        for (size_t j = 0; j < 4; ++j)
+            row.input[j] = std::sin(i * (0.37f + 0.13f * j) + j);
+        row.output[0] = row.input[0] * row.input[1] + 0.5f * row.input[2];
+        row.output[1] = std::sin(3 * row.input[3]) * row.input[0];
+    }
+    return d;
+}
+
+struct Run {
+    double seconds;
+    size_t epochs;
+    float error;
+};
+
+static Run train(bool hogwild, size_t threads, float target, float learning_rate) {
+    const size_t samples = 20000;
+    NNTeacher teacher;
+    auto nn = std::make_unique<NeuralNetwork>();
+    nn->addLayer(std::make_shared<InputLayer>(4));
+    nn->addLayer(std::make_shared<SigmoidLayer>(64));
+    nn->addLayer(std::make_shared<TanHLayer>(64));
+    nn->addLayer(std::make_shared<LinearLayer>(2, false));
+    nn->initializeWithRandomData();
+    teacher.addNetwork(std::move(nn));
+    auto terminator = std::make_unique<TargetErrorTerminator>(target, samples, 200);
+    TargetErrorTerminator& result = *terminator;
+    teacher.addTerminator(std::move(terminator));
+    teacher.addLossFunction(std::make_unique<MeanSquaredLossFun>());
+    teacher.addOptimizer(std::make_unique<NNSgdOptimizer>(learning_rate));
+    teacher.addTrainingDataSet(makeData(samples));
+    teacher.batch_size = 64;
+    teacher.sub_batch_size = 16;
+    teacher.threads = threads;
+    teacher.hogwild = hogwild;
+    teacher.hogwild_learning_rate = learning_rate;
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    while (!teacher.finished())
+        teacher.learnEpoch();
+    std::chrono::duration<double> elapsed = clock::now() - start;
+    return {elapsed.count(), result.epochs, result.last_error};
+}
+
+int main(int argc, char** argv) {
+    size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                              : NNThreadPool::global().size();
+    float target = argc > 2 ? std::strtof(argv[2], nullptr) : 0.003f;
+    float learning_rate = argc > 3 ? std::strtof(argv[3], nullptr) : 0.002f;
+
+    std::printf("%zu threads, target error %g per sample, learning rate %g\n",
+                threads, target, learning_rate);
+    std::printf("%-12s %10s %8s %12s %12s\n", "training", "seconds", "epochs", "s/epoch", "error");
+    for (bool hogwild : {false, true}) {
+        RNG.seed(1234);
+        Run run = train(hogwild, threads, target, learning_rate);
+        std::printf("%-12s %10.3f %8zu %12.4f %12.5f%s\n",
+                    hogwild ? "hogwild" : "synchronous", run.seconds, run.epochs,
+                    run.seconds / std::max<size_t>(run.epochs, 1), run.error,
+                    run.error < target ? "" : "  (target not reached)");
+    }
+}
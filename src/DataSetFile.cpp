@@ -0,0 +1,162 @@
+#include "DataSetFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include "MappedFile.h"
+
+static constexpr size_t data_alignment = 64;
+
+// a header of a file of this version
+static bool isCurrentHeader(const DataSetFileHeader& header) {
+    DataSetFileHeader expected;
+    return std::memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0
+        && header.version == expected.version && header.dtype == 0 && header.layout == 0
+        && header.columns != 0 && header.outputs != 0 && header.outputs <= header.columns;
+}
+
+bool saveDataSetFile(const std::string& path, const CSVData& data) {
+    constexpr size_t max_count = std::numeric_limits<uint32_t>::max();
+    size_t columns = data.headers.size();
+    if (columns > max_count || data.points.inputSize() + data.points.outputSize() != columns) return false;
+    for (const std::string& name : data.headers)
+        if (name.size() > max_count) return false;
+    DataSetFileHeader header;
+    header.columns = static_cast<uint32_t>(columns);
+    header.outputs = static_cast<uint32_t>(data.points.outputSize());
+    header.rows = data.points.size();
+
+    std::vector<float> rows;
+    rows.reserve(data.points.size() * columns);
+    for (size_t row = 0; row < data.points.size(); ++row) {
+        auto p = data.points[row];
+        rows.insert(rows.end(), p.input.begin(), p.input.end());
+        rows.insert(rows.end(), p.output.begin(), p.output.end());
+    }
+
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    size_t written = sizeof(header);
+    for (const std::string& name : data.headers) {
+        uint32_t length = static_cast<uint32_t>(name.size());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(name.data(), length);
+        written += sizeof(length) + length;
+    }
+    const char padding[data_alignment] = {};
+    out.write(padding, (data_alignment - written % data_alignment) % data_alignment);
+    out.write(reinterpret_cast<const char*>(rows.data()), rows.size() * sizeof(float));
+    return static_cast<bool>(out);
+}
+
+bool loadDataSetFile(const std::string& path, CSVData& out) {
+    MappedFile file{path};
+    const char* p = file.data();
+    const char* end = p + file.size();
+
+    DataSetFileHeader header;
+    if (file.size() < sizeof(header)) return false;
+    std::memcpy(&header, p, sizeof(header));
+    if (!isCurrentHeader(header)) return false;
+    p += sizeof(header);
+    size_t columns = header.columns;
+
+    CSVData result;
+    for (size_t c = 0; c < columns; ++c) {
+        uint32_t length;
+        if (static_cast<size_t>(end - p) < sizeof(length)) return false;
+        std::memcpy(&length, p, sizeof(length));
+        p += sizeof(length);
+        if (static_cast<size_t>(end - p) < length) return false;
+        result.headers.emplace_back(p, length);
+        p += length;
+    }
+    size_t padding = (data_alignment - (p - file.data()) % data_alignment) % data_alignment;
+    if (static_cast<size_t>(end - p) < padding) return false;
+    p += padding;
+    if (static_cast<size_t>(end - p) / sizeof(float) / columns < header.rows) return false;
+
+    // copied row by row into the layout of the points
+    size_t inputs = columns - header.outputs;
+    size_t row_bytes = columns * sizeof(float);
+    result.points.resize(header.rows, inputs, header.outputs);
+    for (size_t row = 0; row < header.rows; ++row, p += row_bytes) {
+        std::memcpy(result.points.inputs()[row], p, inputs * sizeof(float));
+        std::memcpy(result.points.outputs()[row], p + inputs * sizeof(float), header.outputs * sizeof(float));
+    }
+    out = std::move(result);
+    return true;
+}
+
+std::string binaryDataSetPath(const std::string& csv_path) {
+    return std::filesystem::path(csv_path).replace_extension(data_set_file_extension).string();
+}
+
+bool hasUpToDateBinary(const std::string& csv_path) {
+    std::string binary_path = binaryDataSetPath(csv_path);
+    std::error_code error;
+    auto binary_time = std::filesystem::last_write_time(binary_path, error);
+    if (error) return false;
+    // one of an older version is not used (nor kept)
+    DataSetFileHeader header;
+    std::ifstream in{binary_path, std::ios::binary};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || !isCurrentHeader(header))
+        return false;
+    auto csv_time = std::filesystem::last_write_time(csv_path, error);
+    return error || binary_time >= csv_time;
+}
+
+// loadCSV, a broken file is reported on stderr and gives nothing
+static CSVData loadCSVReported(const std::string& path) {
+    try {
+        return loadCSV(path);
+    } catch (const std::runtime_error& e) {
+        std::fprintf(stderr, "%s: %s, nothing loaded\n", path.c_str(), e.what());
+        return {};
+    }
+}
+
+CSVData loadDataSet(const std::string& path) {
+    if (std::filesystem::path(path).extension() != data_set_file_extension)
+        return loadCSVReported(path);
+    CSVData data;
+    if (loadDataSetFile(path, data)) return data;
+    std::string csv_path = std::filesystem::path(path).replace_extension(".csv").string();
+    if (std::filesystem::exists(csv_path)) {
+        std::fprintf(stderr, "%s: not a dataset file of version %u, reading %s instead\n",
+                     path.c_str(), DataSetFileHeader{}.version, csv_path.c_str());
+        return loadCSVReported(csv_path);
+    }
+    std::fprintf(stderr, "%s: not a dataset file of version %u, nothing loaded\n",
+                 path.c_str(), DataSetFileHeader{}.version);
+    return data;
+}
+
+size_t convertDataSetDirectory(const std::string& directory) {
+    size_t converted = 0;
+    std::error_code error;
+    for (auto const& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".csv") continue;
+        auto words = splitText(entry.path().stem().string(), '.');
+        bool is_data = !words.empty() && words.front() == "data";
+        bool is_set = std::find(words.begin(), words.end(), "train") != words.end()
+                   || std::find(words.begin(), words.end(), "test") != words.end();
+        std::string csv_path = entry.path().string();
+        if (!is_data || !is_set || hasUpToDateBinary(csv_path)) continue;
+        CSVData data;
+        try {
+            data = loadCSV(csv_path);
+        } catch (const std::runtime_error& e) {
+            std::fprintf(stderr, "%s: %s, not converted\n", csv_path.c_str(), e.what());
+            continue;
+        }
+        if (saveDataSetFile(binaryDataSetPath(csv_path), data)) ++converted;
+    }
+    return converted;
+}
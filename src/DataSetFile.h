@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// Binary dataset files (.nnds), loaded with a single mmap and no parsing.
+// Layout, all of it in native byte order (little endian everywhere this
+// builds):
+//   DataSetFileHeader
+//   the names of the columns, each a uint32_t length and its characters
+//   zero padding up to the next multiple of 64 bytes
+//   float data[rows][columns] (row-major, dtype float32)
+// The last outputs columns of a row are the outputs of the sample, the
+// others its inputs, as in the CSV files. Version 1 files also had the
+// minimum and maximum of every column, nothing read them (the teacher
+// computes its own), they are converted again.
+
+constexpr char data_set_file_extension[] = ".nnds";
+
+struct DataSetFileHeader {
+    char magic[4] = {'N', 'N', 'D', 'S'};
+    uint32_t version = 2;
+    uint32_t columns = 0;
+    uint32_t outputs = 1;
+    uint64_t rows = 0;
+    uint32_t dtype = 0;  // 0 is float32, the only one there is
+    uint32_t layout = 0; // 0 is row-major, the only one there is
+};
+
+// writes data to path as a binary dataset file, false on failure
+bool saveDataSetFile(const std::string& path, const CSVData& data);
+// reads a binary dataset file, false (and out untouched) when path is not
+// one (of this version) or is broken
+bool loadDataSetFile(const std::string& path, CSVData& out);
+
+// path of the binary file next to a CSV file
+std::string binaryDataSetPath(const std::string& csv_path);
+// the binary file of a CSV exists, is of this version and is at least
+// as new as the CSV
+bool hasUpToDateBinary(const std::string& csv_path);
+
+// reads either kind of file, by the extension; a binary file that cannot
+// be read is replaced by the CSV next to it, or reported on stderr (and
+// the result is empty) when there is none; so is a CSV that cannot be
+// parsed (see parseCSV)
+CSVData loadDataSet(const std::string& path);
+
+// writes the binary file of every data.*.train.*.csv and data.*.test.*.csv
+// in directory that has none (or an older one), returns how many it wrote
+size_t convertDataSetDirectory(const std::string& directory);
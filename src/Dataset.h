@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// contiguous floats owned by someone else, like std::span of C++20
+template <typename T>
+class RowSpan {
+public:
+    RowSpan(T* data, size_t size) : data_(data), size_(size) { }
+
+    T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T& operator[](size_t i) const {
+        assert(i < size_);
+        return data_[i];
+    }
+    T& back() const {
+        assert(size_ > 0);
+        return data_[size_ - 1];
+    }
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size_; }
+
+private:
+    T* data_;
+    size_t size_;
+};
+
+// a sample of a Dataset, its rows of the input and the output matrix
+template <typename T>
+struct DataRow {
+    RowSpan<T> input;
+    RowSpan<T> output;
+};
+
+// rows x cols floats, row-major and without padding (stride() is cols()),
+// the storage of a Dataset: unlike NNMatrix the rows are not padded to
+// whole cache lines, which for the few columns of a sample would be most
+// of the memory of the set
+class DataMatrix {
+public:
+    // changes the shape, the contents are zeroed
+    void resize(size_t rows, size_t cols) {
+        values.assign(rows * cols, 0.0f);
+        rows_ = rows;
+        cols_ = cols;
+    }
+    // drops the rows from rows on (or adds rows of zeros), keeps the others
+    void resizeRows(size_t rows) {
+        values.resize(rows * cols_, 0.0f);
+        rows_ = rows;
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t stride() const { return cols_; }
+
+    float* data() { return values.data(); }
+    const float* data() const { return values.data(); }
+    float* operator[](size_t row) {
+        assert(row < rows_);
+        return values.data() + row * cols_;
+    }
+    const float* operator[](size_t row) const {
+        assert(row < rows_);
+        return values.data() + row * cols_;
+    }
+
+    void swap(DataMatrix& other) noexcept {
+        values.swap(other.values);
+        std::swap(rows_, other.rows_);
+        std::swap(cols_, other.cols_);
+    }
+
+private:
+    std::vector<float> values;
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+};
+
+// Samples kept as two matrices, one row per sample: the inputs and the
+// outputs. Two allocations for the whole set, rows next to each other in
+// memory and not padded, so a range of samples is a single block of both
+// matrices; they get to the network (whose batches have padded rows) with
+// a memcpy per sample.
+class Dataset {
+public:
+    Dataset() = default;
+    Dataset(size_t rows, size_t input_size, size_t output_size) {
+        resize(rows, input_size, output_size);
+    }
+
+    // changes the shape, the contents are zeroed
+    void resize(size_t rows, size_t input_size, size_t output_size) {
+        inputs_.resize(rows, input_size);
+        outputs_.resize(rows, output_size);
+    }
+    // drops the rows from rows on (or adds rows of zeros), keeps the others
+    void resizeRows(size_t rows) {
+        inputs_.resizeRows(rows);
+        outputs_.resizeRows(rows);
+    }
+    void clear() { resize(0, 0, 0); }
+
+    size_t size() const { return inputs_.rows(); }
+    bool empty() const { return size() == 0; }
+    size_t inputSize() const { return inputs_.cols(); }
+    size_t outputSize() const { return outputs_.cols(); }
+
+    DataRow<float> operator[](size_t row) {
+        return {{inputs_[row], inputSize()}, {outputs_[row], outputSize()}};
+    }
+    DataRow<const float> operator[](size_t row) const {
+        return {{inputs_[row], inputSize()}, {outputs_[row], outputSize()}};
+    }
+
+    // [sample][input], [sample][output]
+    DataMatrix& inputs() { return inputs_; }
+    DataMatrix& outputs() { return outputs_; }
+    const DataMatrix& inputs() const { return inputs_; }
+    const DataMatrix& outputs() const { return outputs_; }
+
+    // the rows [first, last) into rows from at of into (of the same widths)
+    void copyRows(size_t first, size_t last, Dataset& into, size_t at) const {
+        assert(first <= last && last <= size() && at + (last - first) <= into.size());
+        assert(into.inputSize() == inputSize() && into.outputSize() == outputSize());
+        if (first == last) return;
+        // same widths, the rows are one block in both
+        std::memcpy(into.inputs_[at], inputs_[first], (last - first) * inputs_.stride() * sizeof(float));
+        std::memcpy(into.outputs_[at], outputs_[first], (last - first) * outputs_.stride() * sizeof(float));
+    }
+
+    // a new set of the rows [first, last)
+    Dataset rows(size_t first, size_t last) const {
+        Dataset result(last - first, inputSize(), outputSize());
+        copyRows(first, last, result, 0);
+        return result;
+    }
+
+    void swap(Dataset& other) noexcept {
+        inputs_.swap(other.inputs_);
+        outputs_.swap(other.outputs_);
+    }
+
+private:
+    DataMatrix inputs_;
+    DataMatrix outputs_;
+};
@@ -0,0 +1,63 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define NN_HAS_MMAP 1
+#endif
+
+#if NN_HAS_MMAP
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            // read once from the start to the end, read ahead generously
+            madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(p);
+            size_ = static_cast<size_t>(st.st_size);
+            mapped = true;
+        }
+    }
+    // the mapping stays valid without the descriptor
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (mapped) munmap(const_cast<char*>(data_), size_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    std::ifstream stream{path, std::ios::binary};
+    if (!stream) return;
+    std::ostringstream contents;
+    contents << stream.rdbuf();
+    buffer = std::move(contents).str();
+    data_ = buffer.data();
+    size_ = buffer.size();
+}
+
+MappedFile::~MappedFile() = default;
+
+#endif
+
+void MappedFile::swap(MappedFile& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(mapped, other.mapped);
+    std::swap(buffer, other.buffer);
+    // a read file points into its buffer, short strings do not move along
+    if (!mapped && size_ > 0) data_ = buffer.data();
+    if (!other.mapped && other.size_ > 0) other.data_ = other.buffer.data();
+}
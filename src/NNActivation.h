@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "simd/NNSimd.h"
+
+// Activation functions as plain structs, so DenseLayer can call them
+// without a virtual call. Each one has
+//   apply(in, out, n, accuracy)   out = f(in), in == out is fine
+//   gradient(y, grad, delta, n)   delta = f'(z) * grad, from y = f(z)
+
+struct InputActivation {
+    static constexpr const char* layer_name = "Input layer";
+    void apply(const float* in, float* out, size_t n, NNActivationAccuracy) const {
+        if (in != out) std::copy(in, in + n, out);
+    }
+    void gradient(const float*, const float*, float*, size_t) const {
+        throw "Wrong usage";
+    }
+};
+
+struct SigmoidActivation {
+    static constexpr const char* layer_name = "Sigmoid layer";
+    void apply(const float* in, float* out, size_t n, NNActivationAccuracy accuracy) const {
+        simd().sigmoid[static_cast<size_t>(accuracy)](in, out, n, slope);
+    }
+    void gradient(const float* y, const float* grad, float* delta, size_t n) const {
+        simd().sigmoid_gradient(y, grad, delta, n, slope); // slope * f * (1 - f)
+    }
+    float slope = 1.0f;
+};
+
+struct TanHActivation {
+    static constexpr const char* layer_name = "TanH layer";
+    void apply(const float* in, float* out, size_t n, NNActivationAccuracy accuracy) const {
+        simd().tanh[static_cast<size_t>(accuracy)](in, out, n);
+    }
+    void gradient(const float* y, const float* grad, float* delta, size_t n) const {
+        simd().tanh_gradient(y, grad, delta, n); // 1 - f^2
+    }
+};
+
+struct LinearActivation {
+    static constexpr const char* layer_name = "Linear layer";
+    void apply(const float* in, float* out, size_t n, NNActivationAccuracy) const {
+        if (in != out) std::copy(in, in + n, out);
+    }
+    void gradient(const float*, const float* grad, float* delta, size_t n) const {
+        std::copy(grad, grad + n, delta);
+    }
+};
+
+struct LeakyReluActivation {
+    static constexpr const char* layer_name = "Leaky Relu layer";
+    void apply(const float* in, float* out, size_t n, NNActivationAccuracy) const {
+        simd().leaky_relu(in, out, n, 0.01f);
+    }
+    void gradient(const float* y, const float* grad, float* delta, size_t n) const {
+        simd().leaky_relu_gradient(y, grad, delta, n, 0.01f);
+    }
+};
+
+struct RampActivation {
+    static constexpr const char* layer_name = "Ramp layer";
+    void apply(const float* in, float* out, size_t n, NNActivationAccuracy) const {
+        simd().ramp(in, out, n, t1, t2);
+    }
+    void gradient(const float* y, const float* grad, float* delta, size_t n) const {
+        simd().ramp_gradient(y, grad, delta, n, 1 / (t2 - t1));
+    }
+    float t1 = -1.0f;
+    float t2 = 1.0f;
+};
@@ -2,5 +2,7 @@
 
 #include <vector>
 
-using NNEdgeMatrix = std::vector<std::vector<float>>;
+#include "NNMatrix.h"
+
+using NNEdgeMatrix = NNMatrix; // [out neuron][in neuron]
 using NNLayerValues = std::vector<float>;
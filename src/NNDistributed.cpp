@@ -0,0 +1,185 @@
+#include "NNDistributed.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "NNMatrix.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define NN_HAS_FORK 1
+#endif
+
+#if NN_HAS_FORK
+
+// a worker that went away closes its sockets, so its neighbours end up
+// here too and the whole ring stops instead of waiting forever
+static void socketError(const char* what) {
+    throw std::runtime_error(std::string("NNSocketRing: ") + what + ": " + std::strerror(errno));
+}
+
+NNSocketRing::NNSocketRing(size_t rank, size_t size, int next_fd, int prev_fd)
+    : NNCommunicator(rank, size), next_fd(next_fd), prev_fd(prev_fd) {
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(next_fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+NNSocketRing::~NNSocketRing() {
+    close(next_fd);
+    if (prev_fd != next_fd) close(prev_fd);
+}
+
+void NNSocketRing::exchange(const void* send, size_t send_bytes, void* recv, size_t recv_bytes) {
+#ifdef MSG_NOSIGNAL
+    constexpr int send_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#else
+    constexpr int send_flags = MSG_DONTWAIT;
+#endif
+    // both directions at once, every worker sends before it receives,
+    // so sending everything first would fill the socket buffers and stall
+    auto out = static_cast<const char*>(send);
+    auto in = static_cast<char*>(recv);
+    while (send_bytes > 0 || recv_bytes > 0) {
+        pollfd fds[2] = {};
+        fds[0].fd = send_bytes > 0 ? next_fd : -1;
+        fds[0].events = POLLOUT;
+        fds[1].fd = recv_bytes > 0 ? prev_fd : -1;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            socketError("poll");
+        }
+        if (send_bytes > 0 && fds[0].revents) {
+            ssize_t sent = ::send(next_fd, out, send_bytes, send_flags);
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                socketError("send");
+            if (sent > 0) {
+                out += sent;
+                send_bytes -= sent;
+            }
+        }
+        if (recv_bytes > 0 && fds[1].revents) {
+            ssize_t got = ::recv(prev_fd, in, recv_bytes, MSG_DONTWAIT);
+            if (got == 0) {
+                errno = ECONNRESET;
+                socketError("recv");
+            }
+            if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                socketError("recv");
+            if (got > 0) {
+                in += got;
+                recv_bytes -= got;
+            }
+        }
+    }
+}
+
+bool launchWorkers(size_t workers, const std::function<void(std::unique_ptr<NNCommunicator>)>& worker) {
+    assert(workers > 0);
+    // link i goes from worker i to worker i + 1
+    std::vector<int> links(2 * workers, -1);
+    for (size_t i = 0; i < workers; ++i) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, &links[2 * i]) != 0) {
+            for (int fd : links) if (fd >= 0) close(fd);
+            return false;
+        }
+    }
+    // or the buffered output of the caller is written by every worker
+    std::fflush(nullptr);
+
+    std::vector<pid_t> children;
+    for (size_t rank = 0; rank < workers; ++rank) {
+        pid_t pid = fork();
+        if (pid < 0) break;
+        if (pid == 0) {
+            int next_fd = links[2 * rank];
+            int prev_fd = links[2 * ((rank + workers - 1) % workers) + 1];
+            for (int fd : links)
+                if (fd != next_fd && fd != prev_fd) close(fd);
+            int status = 0;
+            try {
+                worker(std::make_unique<NNSocketRing>(rank, workers, next_fd, prev_fd));
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "worker %zu: %s\n", rank, e.what());
+                status = 1;
+            } catch (...) {
+                status = 1;
+            }
+            std::fflush(nullptr);
+            // not exit, the worker is a copy of the caller, its cleanup is not ours
+            _exit(status);
+        }
+        children.push_back(pid);
+    }
+    for (int fd : links) close(fd);
+
+    bool ok = children.size() == workers;
+    for (pid_t pid : children) {
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok;
+}
+
+#else
+
+NNSocketRing::NNSocketRing(size_t rank, size_t size, int next_fd, int prev_fd)
+    : NNCommunicator(rank, size), next_fd(next_fd), prev_fd(prev_fd) { }
+
+NNSocketRing::~NNSocketRing() = default;
+
+void NNSocketRing::exchange(const void*, size_t, void*, size_t) {
+    throw std::runtime_error("NNSocketRing: not supported on this platform");
+}
+
+bool launchWorkers(size_t, const std::function<void(std::unique_ptr<NNCommunicator>)>&) {
+    return false;
+}
+
+#endif
+
+void ringAllReduce(NNCommunicator& comm, float* data, size_t n) {
+    size_t size = comm.size();
+    if (size < 2 || n == 0) return;
+    size_t rank = comm.rank();
+    auto chunk_begin = [&](size_t c) { return c * n / size; };
+    auto chunk_size = [&](size_t c) { return chunk_begin(c + 1) - chunk_begin(c); };
+    // the largest chunk, reused between calls
+    thread_local std::vector<float> received;
+    received.resize(n / size + 1);
+
+    // reduce-scatter: chunk c starts at worker c, every worker adds its
+    // part and passes it on, after size - 1 steps worker c - 1 has the sum
+    for (size_t step = 0; step + 1 < size; ++step) {
+        size_t send_chunk = (rank + size - step) % size;
+        size_t recv_chunk = (rank + size - step - 1) % size;
+        comm.exchange(data + chunk_begin(send_chunk), chunk_size(send_chunk) * sizeof(float),
+                      received.data(), chunk_size(recv_chunk) * sizeof(float));
+        float* into = data + chunk_begin(recv_chunk);
+        for (size_t i = 0; i < chunk_size(recv_chunk); ++i)
+            into[i] += received[i];
+    }
+    // all-gather: the sums go around once more, overwriting the parts
+    for (size_t step = 0; step + 1 < size; ++step) {
+        size_t send_chunk = (rank + 1 + size - step) % size;
+        size_t recv_chunk = (rank + size - step) % size;
+        comm.exchange(data + chunk_begin(send_chunk), chunk_size(send_chunk) * sizeof(float),
+                      data + chunk_begin(recv_chunk), chunk_size(recv_chunk) * sizeof(float));
+    }
+}
+
+void ringAllReduce(NNCommunicator& comm, std::vector<NNEdgeMatrix>& matrices) {
+    for (auto& m : matrices) ringAllReduce(comm, m.data(), m.bufferSize());
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "NNAliases.h"
+
+// Data-parallel training in several processes on one machine: every
+// worker process has an NNTeacher of its own with the whole training set,
+// computes its part of every batch, and the gradients of every step are
+// summed over all the workers (an all-reduce), so their weights stay the
+// same, the ones a single process would get.
+// Every worker holding all of the set is on purpose, it costs a copy of
+// the set per worker and buys the steps of a single process:
+//  - a batch is drawn from the whole set (one permutation of the epoch,
+//    from the shuffle stream all the workers share), so the part of a
+//    worker is any rows at all. Workers holding a range of rows each would
+//    either draw their parts from their own rows only, which are other
+//    batches than those of one process, or compute the rows of a batch
+//    that fall in their range, parts of a different size every batch, the
+//    whole step waiting for the biggest one;
+//  - the inputs are normalized by the minimum and maximum over the set,
+//    which every worker computes for itself.
+// The workers are processes of one machine and the sets the ones this
+// program loads into memory anyway (a CSV or a binary set file of the
+// GUI); for sets that do not fit that many times, the rows would have to
+// be sharded as above, the statistics all-reduced, and the batches evened
+// out between the workers.
+
+// Connection of a worker to its neighbours in a ring of workers, the
+// all-reduce only ever talks to them. The transport is up to the
+// implementation (NNSocketRing works with any connected stream sockets,
+// Unix domain ones from launchWorkers or TCP ones).
+class NNCommunicator {
+public:
+    virtual ~NNCommunicator() = default;
+
+    size_t rank() const { return rank_; }    // place in the ring
+    size_t size() const { return size_; }    // number of workers
+
+    // sends send_bytes to the next worker while receiving recv_bytes
+    // from the previous one, returns when both are done
+    virtual void exchange(const void* send, size_t send_bytes, void* recv, size_t recv_bytes) = 0;
+
+protected:
+    NNCommunicator(size_t rank, size_t size) : rank_(rank), size_(size) { }
+
+private:
+    size_t rank_;
+    size_t size_;
+};
+
+// NNCommunicator over two connected stream sockets, owns them
+class NNSocketRing : public NNCommunicator {
+public:
+    NNSocketRing(size_t rank, size_t size, int next_fd, int prev_fd);
+    ~NNSocketRing() override;
+    NNSocketRing(const NNSocketRing&) = delete;
+    NNSocketRing& operator=(const NNSocketRing&) = delete;
+
+    void exchange(const void* send, size_t send_bytes, void* recv, size_t recv_bytes) override;
+
+private:
+    int next_fd;
+    int prev_fd;
+};
+
+// data[0 .. n) = the sum of data[0 .. n) of all the workers (ring
+// all-reduce, Patarasuk and Yuan 2009): the data is cut into one chunk per
+// worker, the chunks go around the ring once being summed and once more
+// being handed out, so every worker sends and receives 2 * (size - 1) / size
+// of the data whatever the number of workers. The sum of a chunk is made
+// by the same additions in the same order on every run.
+void ringAllReduce(NNCommunicator& comm, float* data, size_t n);
+// the same for every matrix (padding included, it is zero anyway)
+void ringAllReduce(NNCommunicator& comm, std::vector<NNEdgeMatrix>& matrices);
+
+// Starts workers processes (fork), connected in a ring of Unix domain
+// sockets, and calls worker(communicator) in each of them. Returns when
+// all are done, true when all of them finished without an exception.
+// The worker gets a copy of everything the calling process had, so data
+// loaded before is there (shared until written to). Threads are not
+// copied, so call it before anything starts the thread pool.
+// Only where fork is, returns false elsewhere.
+bool launchWorkers(size_t workers, const std::function<void(std::unique_ptr<NNCommunicator>)>& worker);
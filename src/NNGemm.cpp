@@ -0,0 +1,174 @@
+#include "NNGemm.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+
+#include "simd/NNSimd.h"
+
+// Goto/BLIS style gemm: op(B) is packed into KC x NR slivers and op(A) into
+// MR x KC slivers, so the micro-kernel streams both operands contiguously
+// and keeps an MR x NR tile of C in registers for the whole KC loop.
+// Packing also takes care of transposition and of zero padding the edges,
+// so the micro-kernel only ever sees full tiles.
+
+// register tile of the micro-kernel, the kernels themselves are in simd/
+static constexpr size_t MR = gemm_mr;
+static constexpr size_t NR = gemm_nr;
+
+// cache blocking: a KC x NR sliver of B stays in L1 while the micro-kernel
+// walks the MC x KC block of A kept in L2, the KC x NC panel of B is for L3
+static constexpr size_t KC = 256;
+static constexpr size_t MC = 96;
+static constexpr size_t NC = 2048;
+
+static constexpr size_t alignment = 64;
+
+struct PackedBufferDeleter {
+    void operator()(float* p) const {
+        ::operator delete[](p, std::align_val_t{alignment});
+    }
+};
+using PackedBuffer = std::unique_ptr<float[], PackedBufferDeleter>;
+
+static PackedBuffer makeBuffer(size_t size) {
+    return PackedBuffer(static_cast<float*>(
+        ::operator new[](size * sizeof(float), std::align_val_t{alignment})));
+}
+
+// packing buffers are per thread, so independent gemms can run in parallel
+static float* packedABuffer() {
+    thread_local PackedBuffer buffer = makeBuffer(MC * KC);
+    return buffer.get();
+}
+static float* packedBBuffer() {
+    thread_local PackedBuffer buffer = makeBuffer(KC * NC);
+    return buffer.get();
+}
+
+// packs op(A)[i0 .. i0 + mc)[p0 .. p0 + kc) into MR-row slivers, [sliver][k][MR]
+static void packA(bool trans, const float* A, size_t lda,
+                  size_t i0, size_t mc, size_t p0, size_t kc, float* out) {
+    for (size_t ir = 0; ir < mc; ir += MR) {
+        size_t mr = std::min(MR, mc - ir);
+        float* dst = out + ir * kc;
+        if (trans) {
+            for (size_t p = 0; p < kc; ++p) {
+                const float* src = A + (p0 + p) * lda + i0 + ir;
+                size_t i = 0;
+                for (; i < mr; ++i) dst[p * MR + i] = src[i];
+                for (; i < MR; ++i) dst[p * MR + i] = 0.0f;
+            }
+        } else {
+            for (size_t i = 0; i < mr; ++i) {
+                const float* src = A + (i0 + ir + i) * lda + p0;
+                for (size_t p = 0; p < kc; ++p) dst[p * MR + i] = src[p];
+            }
+            for (size_t i = mr; i < MR; ++i)
+                for (size_t p = 0; p < kc; ++p) dst[p * MR + i] = 0.0f;
+        }
+    }
+}
+
+// packs op(B)[p0 .. p0 + kc)[j0 .. j0 + nc) into NR-column slivers, [sliver][k][NR]
+static void packB(bool trans, const float* B, size_t ldb,
+                  size_t p0, size_t kc, size_t j0, size_t nc, float* out) {
+    for (size_t jr = 0; jr < nc; jr += NR) {
+        size_t nr = std::min(NR, nc - jr);
+        float* dst = out + jr * kc;
+        if (trans) {
+            for (size_t j = 0; j < nr; ++j) {
+                const float* src = B + (j0 + jr + j) * ldb + p0;
+                for (size_t p = 0; p < kc; ++p) dst[p * NR + j] = src[p];
+            }
+            for (size_t j = nr; j < NR; ++j)
+                for (size_t p = 0; p < kc; ++p) dst[p * NR + j] = 0.0f;
+        } else {
+            for (size_t p = 0; p < kc; ++p) {
+                const float* src = B + (p0 + p) * ldb + j0 + jr;
+                size_t j = 0;
+                for (; j < nr; ++j) dst[p * NR + j] = src[j];
+                for (; j < NR; ++j) dst[p * NR + j] = 0.0f;
+            }
+        }
+    }
+}
+
+static void scaleMatrix(size_t M, size_t N, float beta, float* C, size_t ldc) {
+    for (size_t i = 0; i < M; ++i) {
+        float* c = C + i * ldc;
+        if (beta == 0.0f) std::fill(c, c + N, 0.0f);
+        else for (size_t j = 0; j < N; ++j) c[j] *= beta;
+    }
+}
+
+void gemm(bool trans_a, bool trans_b,
+          size_t M, size_t N, size_t K,
+          float alpha,
+          const float* A, size_t lda,
+          const float* B, size_t ldb,
+          float beta,
+          float* C, size_t ldc,
+          const NNGemmEpilogue* epilogue) {
+    if (M == 0 || N == 0) return;
+    if (K == 0 || alpha == 0.0f) {
+        scaleMatrix(M, N, beta, C, ldc);
+        if (epilogue) epilogue->apply(epilogue->context, C, ldc, M, N);
+        return;
+    }
+
+    float* packed_a = packedABuffer();
+    float* packed_b = packedBBuffer();
+    auto micro_kernel = simd().gemm_micro_kernel;
+
+    for (size_t jc = 0; jc < N; jc += NC) {
+        size_t nc = std::min(NC, N - jc);
+        for (size_t pc = 0; pc < K; pc += KC) {
+            size_t kc = std::min(KC, K - pc);
+            // C is scaled by beta only once, the next blocks of K accumulate
+            float beta_block = pc == 0 ? beta : 1.0f;
+            packB(trans_b, B, ldb, pc, kc, jc, nc, packed_b);
+
+            for (size_t ic = 0; ic < M; ic += MC) {
+                size_t mc = std::min(MC, M - ic);
+                packA(trans_a, A, lda, ic, mc, pc, kc, packed_a);
+
+                for (size_t jr = 0; jr < nc; jr += NR) {
+                    size_t nr = std::min(NR, nc - jr);
+                    for (size_t ir = 0; ir < mc; ir += MR) {
+                        size_t mr = std::min(MR, mc - ir);
+                        micro_kernel(kc, packed_a + ir * kc, packed_b + jr * kc,
+                                    alpha, beta_block,
+                                    C + (ic + ir) * ldc + jc + jr, ldc, mr, nr);
+                    }
+                }
+                // the block of C is final after the last block of K
+                if (epilogue && pc + kc == K)
+                    epilogue->apply(epilogue->context, C + ic * ldc + jc, ldc, mc, nc);
+            }
+        }
+    }
+}
+
+void gemv(bool trans,
+          size_t M, size_t N,
+          float alpha,
+          const float* A, size_t lda,
+          const float* x,
+          float beta,
+          float* y) {
+    const NNSimdKernels& kernels = simd();
+    if (!trans) {
+        // y[i] = dot(A[i], x)
+        for (size_t i = 0; i < M; ++i) {
+            float acc = kernels.dot(A + i * lda, x, N);
+            y[i] = alpha * acc + (beta == 0.0f ? 0.0f : beta * y[i]);
+        }
+    } else {
+        // y = sum over rows of A[i] * x[i], rows are streamed contiguously
+        if (beta == 0.0f) std::fill(y, y + N, 0.0f);
+        else if (beta != 1.0f) for (size_t j = 0; j < N; ++j) y[j] *= beta;
+        for (size_t i = 0; i < M; ++i)
+            kernels.axpy(alpha * x[i], A + i * lda, y, N);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+// Small linear algebra core used by the layers.
+// All matrices are row-major, ld* is the distance between rows in floats
+// (NNMatrix::stride() for matrices kept in NNMatrix).
+
+// Called on every finished block of C (at most a few hundred rows), while
+// it is still in cache, so element-wise work on the result (activation
+// functions) does not need another trip through memory.
+struct NNGemmEpilogue {
+    void (*apply)(const void* context, float* C, size_t ldc, size_t rows, size_t cols);
+    const void* context;
+};
+
+// C = alpha * op(A) * op(B) + beta * C
+// op(A) is M x K, op(B) is K x N, C is M x N,
+// op(X) is X^T when the corresponding trans_* flag is set.
+// When beta is 0, C is not read (so it may hold garbage).
+// The epilogue, if any, sees every element of C exactly once.
+void gemm(bool trans_a, bool trans_b,
+          size_t M, size_t N, size_t K,
+          float alpha,
+          const float* A, size_t lda,
+          const float* B, size_t ldb,
+          float beta,
+          float* C, size_t ldc,
+          const NNGemmEpilogue* epilogue = nullptr);
+
+// y = alpha * op(A) * x + beta * y
+// A is M x N, op(A) is A^T when trans is set.
+// When beta is 0, y is not read.
+void gemv(bool trans,
+          size_t M, size_t N,
+          float alpha,
+          const float* A, size_t lda,
+          const float* x,
+          float beta,
+          float* y);
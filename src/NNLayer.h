@@ -3,199 +3,338 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
-#include <numeric>
 
+#include "NNActivation.h"
 #include "NNAliases.h"
+#include "NNGemm.h"
+#include "NNMath.h"
+#include "NNWorkspace.h"
+#include "simd/NNSimd.h"
 
 // an abstract class for all kinds of layers
 // manages forward and backward propagation
+// A layer holds no state of the propagation, all of it lives in the
+// workspace passed in, so one layer can be used by many threads at once.
 class NNLayer {
 public:
-    void assignValues(const NNLayerValues& new_values_pre) {
+    virtual ~NNLayer() = default;
+
+    void assignValues(const NNLayerValues& new_values_pre, NNLayerWorkspace& ws) const {
         assert(new_values_pre.size() == getSize()); // no bias in data, duh
-        std::copy(new_values_pre.begin(), new_values_pre.end(), pre_values.begin());
-        applyActivationFunction();
+        assert(ws.sample_values.size() == getFullSize());
+        activate(new_values_pre.data(), ws.sample_values.data(), getSize());
     }
 
-    virtual const char* getName() = 0;
+    virtual const char* getName() const = 0;
 
-    // calculates value of the neurons, stores it inside the class
+    // calculates value of the neurons, stores it in ws.sample_values
     void calculateValues(const NNLayerValues& prev_layer,
-                                 const NNEdgeMatrix& edges) {
-        for (size_t neuron_id = 0; neuron_id < size; ++neuron_id)
-            pre_values[neuron_id] = std::inner_product(
-                                    std::begin(prev_layer),
-                                    std::end(prev_layer),
-                                    std::begin(edges[neuron_id]),
-                                    0.0f);
-        applyActivationFunction();
-    }
-
-    // given gradient of the layer, returns gradient of the previous edges
-    // and gradient of the previous layer
-    virtual std::pair<NNEdgeMatrix, NNLayerValues> backwardPropagation(
-        const NNLayerValues& gradient_of_activation, // gradient dCost/dA(Layer)
+                         const NNEdgeMatrix& edges,
+                         NNLayerWorkspace& ws) const {
+        assert(prev_layer.size() == edges.cols());
+        assert(ws.sample_values.size() == getFullSize());
+        // weighted inputs first, the activation function is applied in place
+        gemv(false, size, edges.cols(), 1.0f, edges.data(), edges.stride(),
+             prev_layer.data(), 0.0f, ws.sample_values.data());
+        activate(ws.sample_values.data(), ws.sample_values.data(), getSize());
+    }
+
+    // batched versions of the above, one sample per row,
+    // results are stored in values of the workspace
+    void assignBatchValues(const NNMatrix& new_values_pre, NNLayerWorkspace& ws) const {
+        assert(new_values_pre.cols() == getSize());
+        ws.values.setShape(new_values_pre.rows(), getFullSize());
+        for (size_t sample = 0; sample < ws.values.rows(); ++sample)
+            activate(new_values_pre[sample], ws.values[sample], getSize());
+        setBiasColumn(ws);
+    }
+
+    virtual void calculateBatchValues(const NNMatrix& prev_layer,
+                                      const NNEdgeMatrix& edges,
+                                      NNLayerWorkspace& ws) const {
+        multiplyIntoValues(prev_layer, edges, ws, nullptr);
+        for (size_t sample = 0; sample < ws.values.rows(); ++sample)
+            activate(ws.values[sample], ws.values[sample], getSize());
+    }
+
+    // given gradient of the layer (ws.sample_gradient), calculates gradient
+    // of the previous edges and gradient of the previous layer
+    void backwardPropagation(
         const NNLayerValues& previous_layer,
-        const NNEdgeMatrix& edges
-    ) {
-        assert(gradient_of_activation.size() == getSize() + hasBias());
-        NNLayerValues gradient_of_accumulation = // gradient of sum of edges dCost/dZ[layer] = dA[layer]/dZ[layer] * dCost / dA[layer]
-                                                 // where Z is sum (w * x) (weighted input)
-            calculateActivationToAccumulationGradient(gradient_of_activation);
-
-        NNEdgeMatrix edges_gradient(getSize());
-        for (auto& v : edges_gradient) v.resize(previous_layer.size());
-
-        NNLayerValues gradient_of_prev_layer(previous_layer.size());
-
-        for (size_t out_neuron_id = 0; out_neuron_id < getSize(); ++out_neuron_id) {
-            float acc_grad_out_neuron = gradient_of_accumulation[out_neuron_id];
-            for (size_t in_neuron_id = 0; in_neuron_id < previous_layer.size(); ++in_neuron_id) {
-                edges_gradient[out_neuron_id][in_neuron_id] = previous_layer[in_neuron_id] * acc_grad_out_neuron;
-                gradient_of_prev_layer[in_neuron_id] +=
-                    edges[out_neuron_id][in_neuron_id] * acc_grad_out_neuron;
-            }
-        }
-
-        return {std::move(edges_gradient), std::move(gradient_of_prev_layer)};
-    };
+        const NNEdgeMatrix& edges,
+        NNLayerWorkspace& ws,
+        NNEdgeMatrix& edges_gradient,           // out
+        NNLayerValues& gradient_of_prev_layer   // out
+    ) const {
+        assert(ws.sample_gradient.size() == getSize() + hasBias());
+        assert(gradient_of_prev_layer.size() == previous_layer.size());
+        // gradient of sum of edges dCost/dZ[layer] = dA[layer]/dZ[layer] * dCost / dA[layer]
+        // where Z is sum (w * x) (weighted input)
+        NNLayerValues& gradient_of_accumulation = ws.sample_delta;
+        activationGradient(ws.sample_values.data(), ws.sample_gradient.data(),
+                           gradient_of_accumulation.data(), getSize());
+
+        // dW = dZ * A_prev^T, an outer product (a gemm with K = 1)
+        edges_gradient.setShape(getSize(), previous_layer.size());
+        gemm(false, false, getSize(), previous_layer.size(), 1,
+             1.0f, gradient_of_accumulation.data(), 1,
+             previous_layer.data(), previous_layer.size(),
+             0.0f, edges_gradient.data(), edges_gradient.stride());
+        // dA_prev = W^T * dZ
+        gemv(true, getSize(), previous_layer.size(), 1.0f, edges.data(), edges.stride(),
+             gradient_of_accumulation.data(), 0.0f, gradient_of_prev_layer.data());
+    }
+
+    // batched version of the above, for the batch evaluated last with ws,
+    // gradient of the edges is summed over all samples of the batch
+    // (and added to edges_gradient when accumulating)
+    virtual void backwardPropagationBatch(
+        const NNMatrix& previous_layer,         // [sample][prev neuron]
+        const NNEdgeMatrix& edges,
+        NNLayerWorkspace& ws,                   // gradient in, delta is filled
+        NNEdgeMatrix& edges_gradient,           // out
+        NNMatrix& gradient_of_prev_layer,       // out, [sample][prev neuron]
+        bool accumulate = false
+    ) const {
+        backwardPropagationBatchWith(previous_layer, edges, ws, edges_gradient, gradient_of_prev_layer, accumulate,
+            [this](const float* activated, const float* in, float* out, size_t n) {
+                activationGradient(activated, in, out, n);
+            });
+    }
+
+    // A wide layer split by its neurons between threads (NNModelParallel):
+    // the shards work on the neurons [first, last) each, all at once and
+    // with the same ws, once a single thread prepared ws with
+    // prepareBatchValues (forward) or prepareBatchDelta (backward).
+    void prepareBatchValues(size_t samples, NNLayerWorkspace& ws) const {
+        ws.values.setShape(samples, getFullSize());
+        setBiasColumn(ws);
+    }
+    void prepareBatchDelta(NNLayerWorkspace& ws) const { prepareDelta(ws); }
+
+    // values of the neurons [first, last) for the batch, straight into
+    // their columns of ws.values, edges is the whole connection
+    virtual void calculateBatchValuesPart(const NNMatrix& prev_layer,
+                                          const NNEdgeMatrix& edges,
+                                          size_t first, size_t last,
+                                          NNLayerWorkspace& ws) const {
+        multiplyIntoColumns(prev_layer, edges, first, last, ws, nullptr);
+        for (size_t sample = 0; sample < ws.values.rows(); ++sample)
+            activate(ws.values[sample] + first, ws.values[sample] + first, last - first);
+    }
+
+    // gradient of the rows [first, last) of the connection, summed over the
+    // batch (and added to edges_gradient when accumulating), and the part
+    // of the gradient of the previous layer coming through these neurons,
+    // the parts of all the shards sum up to the whole gradient
+    void backwardPropagationBatchPart(
+        const NNMatrix& previous_layer,         // [sample][prev neuron]
+        const NNEdgeMatrix& edges,
+        size_t first, size_t last,
+        NNLayerWorkspace& ws,                   // gradient in, delta is filled
+        NNEdgeMatrix& edges_gradient,           // out, rows [first, last) only
+        NNMatrix& gradient_of_prev_layer_part,  // out, [sample][prev neuron]
+        bool accumulate = false
+    ) const {
+        assert(edges_gradient.rows() == edges.rows() && edges_gradient.cols() == edges.cols());
+        size_t samples = ws.delta.rows();
+        for (size_t sample = 0; sample < samples; ++sample)
+            activationGradient(ws.values[sample] + first, ws.gradient[sample] + first,
+                               ws.delta[sample] + first, last - first);
+        // dW[first, last) = delta[first, last)^T * A_prev
+        gemm(true, false, last - first, previous_layer.cols(), samples,
+             1.0f, ws.delta.data() + first, ws.delta.stride(),
+             previous_layer.data(), previous_layer.stride(),
+             accumulate ? 1.0f : 0.0f,
+             edges_gradient.data() + first * edges_gradient.stride(), edges_gradient.stride());
+        // dA_prev part = delta[first, last) * W[first, last)
+        gradient_of_prev_layer_part.setShape(samples, edges.cols());
+        gemm(false, false, samples, edges.cols(), last - first,
+             1.0f, ws.delta.data() + first, ws.delta.stride(),
+             edges.data() + first * edges.stride(), edges.stride(),
+             0.0f, gradient_of_prev_layer_part.data(), gradient_of_prev_layer_part.stride());
+    }
 
     size_t getSize() const { return size; }
-    size_t getFullSize() const { return values.size(); }
+    size_t getFullSize() const { return size + has_bias; }
 
-    bool hasBias() {
-        return getSize() != values.size();
+    bool hasBias() const {
+        return has_bias;
     }
 
+    // trades precision of the activation function for speed,
+    // only matters for the layers with transcendental functions
+    void setActivationAccuracy(NNActivationAccuracy new_accuracy) { accuracy = new_accuracy; }
+    NNActivationAccuracy getActivationAccuracy() const { return accuracy; }
+
     // oh no public data
     // anyway
     const size_t size;
-    NNLayerValues pre_values; // without activation function, weighted inputs
-    NNLayerValues values;     // with activation function
+    const bool has_bias;
 
 protected:
     NNLayer(size_t size, bool has_bias)
-        : size(size), pre_values(size), values(size + has_bias) {
-            if (has_bias) values.back() = 1;
-        }
+        : size(size), has_bias(has_bias) { }
+
+    // applies the activation function to n weighted inputs, in == out is fine
+    virtual void activate(const float* in, float* out, size_t n) const = 0;
+
+    // weighted inputs of the batch straight into ws.values, the epilogue
+    // (if any) gets the blocks of them while they are still in cache
+    void multiplyIntoValues(const NNMatrix& prev_layer, const NNEdgeMatrix& edges,
+                            NNLayerWorkspace& ws, const NNGemmEpilogue* epilogue) const {
+        ws.values.setShape(prev_layer.rows(), getFullSize());
+        multiplyIntoColumns(prev_layer, edges, 0, getSize(), ws, epilogue);
+        setBiasColumn(ws);
+    }
 
-    virtual void applyActivationFunction() = 0;
-    virtual NNLayerValues calculateActivationToAccumulationGradient(const NNLayerValues&) = 0;
+    // the same for the neurons [first, last) only, ws.values has its shape already
+    void multiplyIntoColumns(const NNMatrix& prev_layer, const NNEdgeMatrix& edges,
+                             size_t first, size_t last,
+                             NNLayerWorkspace& ws, const NNGemmEpilogue* epilogue) const {
+        assert(prev_layer.cols() == edges.cols());
+        assert(edges.rows() == getSize() && first <= last && last <= getSize());
+        assert(ws.values.rows() == prev_layer.rows());
+        gemm(false, true, prev_layer.rows(), last - first, prev_layer.cols(),
+             1.0f, prev_layer.data(), prev_layer.stride(),
+             edges.data() + first * edges.stride(), edges.stride(),
+             0.0f, ws.values.data() + first, ws.values.stride(), epilogue);
+    }
 
-};
+    void setBiasColumn(NNLayerWorkspace& ws) const {
+        if (!hasBias()) return;
+        for (size_t sample = 0; sample < ws.values.rows(); ++sample)
+            ws.values[sample][getSize()] = 1;
+    }
 
-class InputLayer : public NNLayer {
-    public:
-    InputLayer(size_t size, bool has_bias = true) : NNLayer(size, has_bias) { }
-    void applyActivationFunction() override {
-        std::copy(pre_values.begin(), pre_values.end(), values.begin());
+    void prepareDelta(NNLayerWorkspace& ws) const {
+        assert(ws.gradient.rows() == ws.values.rows());
+        assert(ws.gradient.cols() >= getSize());
+        ws.delta.setShape(ws.values.rows(), getSize());
     }
-    const char* getName() override { return "Input layer"; }
-    NNLayerValues calculateActivationToAccumulationGradient(const NNLayerValues&) override {
-        throw "Wrong usage";
+
+    // the body of backwardPropagationBatch, gradient(activated, in, out, n)
+    // is the activation gradient step, turning dCost/dA of a sample into
+    // its delta; the layers pass their own, as they do the epilogue forward
+    template <typename Gradient>
+    void backwardPropagationBatchWith(const NNMatrix& previous_layer, const NNEdgeMatrix& edges,
+                                      NNLayerWorkspace& ws, NNEdgeMatrix& edges_gradient,
+                                      NNMatrix& gradient_of_prev_layer, bool accumulate,
+                                      Gradient gradient) const {
+        prepareDelta(ws);
+        for (size_t sample = 0; sample < ws.delta.rows(); ++sample)
+            gradient(ws.values[sample], ws.gradient[sample], ws.delta[sample], getSize());
+        propagateDelta(previous_layer, edges, ws, edges_gradient, gradient_of_prev_layer, accumulate);
+    }
+
+    // given ws.delta (dCost/dZ) of the batch
+    void propagateDelta(const NNMatrix& previous_layer, const NNEdgeMatrix& edges,
+                        const NNLayerWorkspace& ws, NNEdgeMatrix& edges_gradient,
+                        NNMatrix& gradient_of_prev_layer, bool accumulate) const {
+        multiplyAtB(ws.delta, previous_layer, edges_gradient, accumulate); // dW = delta^T * A_prev
+        multiplyAB(ws.delta, edges, gradient_of_prev_layer);   // dA_prev = delta * W
     }
+
+    // multiplies n gradients by the derivative of the activation function,
+    // the derivative is computed from the values the activation function produced
+    virtual void activationGradient(const float* activated, const float* in, float* out, size_t n) const = 0;
+
+    NNActivationAccuracy accuracy = NNActivationAccuracy::Precise;
+
 };
 
-class SigmoidLayer : public NNLayer {
+// A layer with the activation function known at compile time (one of
+// NNActivation.h). The batch paths call it without virtual calls, the
+// forward one inside the gemm epilogue, so the weighted inputs never
+// make a separate trip through memory.
+// NNLayer stays the interface the network and the GUI work with.
+template <typename Activation>
+class DenseLayer : public NNLayer {
 public:
-    SigmoidLayer(size_t size, bool has_bias = true, float slope = 1.0f) : NNLayer(size, has_bias), slope{slope} { }
-    void applyActivationFunction() override {
-        std::transform(pre_values.begin(), pre_values.end(), values.begin(), [this](float x) { return this->f(x); });
-    }
-    const char* getName() override { return "Sigmoid layer"; }
+    DenseLayer(size_t size, bool has_bias, Activation activation = {})
+        : NNLayer(size, has_bias), activation{activation} { }
+
+    const char* getName() const override { return Activation::layer_name; }
 
-    NNLayerValues calculateActivationToAccumulationGradient(const NNLayerValues& in) override {
-        NNLayerValues results(getSize());
-        for(size_t i = 0; i < getSize(); ++i) {
-            results[i] = fp(pre_values[i]) * in[i];
-        }
-        return results;
+    void activate(const float* in, float* out, size_t n) const override {
+        activation.apply(in, out, n, accuracy);
     }
-private:
-    float slope;
-    float f(float x) { return 1.0f / (1.0f + expf(-slope * x)); }
-    float fp(float x) {
-        float fx = f(x);
-        return slope * fx * (1 - fx);
+    void activationGradient(const float* activated, const float* in, float* out, size_t n) const override {
+        activation.gradient(activated, in, out, n);
     }
-};
 
+    void calculateBatchValues(const NNMatrix& prev_layer,
+                              const NNEdgeMatrix& edges,
+                              NNLayerWorkspace& ws) const override {
+        NNGemmEpilogue epilogue{&activateBlock, this};
+        multiplyIntoValues(prev_layer, edges, ws, &epilogue);
+    }
 
-class TanHLayer : public NNLayer {
-    public:
-    TanHLayer(size_t size, bool has_bias = true) : NNLayer(size, has_bias) { }
-    void applyActivationFunction() override {
-        std::transform(pre_values.begin(), pre_values.end(), values.begin(), [this](float x) { return this->f(x); });
+    void calculateBatchValuesPart(const NNMatrix& prev_layer,
+                                  const NNEdgeMatrix& edges,
+                                  size_t first, size_t last,
+                                  NNLayerWorkspace& ws) const override {
+        NNGemmEpilogue epilogue{&activateBlock, this};
+        multiplyIntoColumns(prev_layer, edges, first, last, ws, &epilogue);
     }
-    const char* getName() override { return "TanH layer"; }
 
-    NNLayerValues calculateActivationToAccumulationGradient(const NNLayerValues& in) override {
-        NNLayerValues results(getSize());
-        for(size_t i = 0; i < getSize(); ++i) {
-            results[i] = fp(pre_values[i]) * in[i];
-        }
-        return results;
+    void backwardPropagationBatch(
+        const NNMatrix& previous_layer,
+        const NNEdgeMatrix& edges,
+        NNLayerWorkspace& ws,
+        NNEdgeMatrix& edges_gradient,
+        NNMatrix& gradient_of_prev_layer,
+        bool accumulate = false
+    ) const override {
+        backwardPropagationBatchWith(previous_layer, edges, ws, edges_gradient, gradient_of_prev_layer, accumulate,
+            [this](const float* activated, const float* in, float* out, size_t n) {
+                activation.gradient(activated, in, out, n);
+            });
     }
 
-    float f(float x) { return tanhf(x); }
-    float fp(float x) { float fx = f(x); return 1 - fx*fx; }
-};
+protected:
+    Activation activation;
 
+private:
+    // the block is a part of the output neurons, never the bias column
+    static void activateBlock(const void* context, float* C, size_t ldc, size_t rows, size_t cols) {
+        auto layer = static_cast<const DenseLayer*>(context);
+        for (size_t r = 0; r < rows; ++r)
+            layer->activation.apply(C + r * ldc, C + r * ldc, cols, layer->accuracy);
+    }
+};
 
-class LinearLayer : public NNLayer {
+class InputLayer : public DenseLayer<InputActivation> {
     public:
-    LinearLayer(size_t size, bool has_bias = true) : NNLayer(size, has_bias) { }
-    void applyActivationFunction() override {
-        std::copy(pre_values.begin(), pre_values.end(), values.begin());
-    }
-    const char* getName() override { return "Linear layer"; }
+    InputLayer(size_t size, bool has_bias = true) : DenseLayer(size, has_bias) { }
+};
 
-    NNLayerValues calculateActivationToAccumulationGradient(const NNLayerValues& in) override {
-        NNLayerValues results(getSize());
-        for(size_t i = 0; i < getSize(); ++i) {
-            results[i] = in[i];
-        }
-        return results;
-    }
+class SigmoidLayer : public DenseLayer<SigmoidActivation> {
+public:
+    SigmoidLayer(size_t size, bool has_bias = true, float slope = 1.0f)
+        : DenseLayer(size, has_bias, SigmoidActivation{slope}) { }
 };
 
 
-class LeakyRelu : public NNLayer {
+class TanHLayer : public DenseLayer<TanHActivation> {
     public:
-    LeakyRelu(size_t size, bool has_bias = true) : NNLayer(size, has_bias) { }
-    void applyActivationFunction() override {
-        std::transform(pre_values.begin(), pre_values.end(), values.begin(), [](float f) {return std::max(f, 0.01f*f);});
-    }
-    const char* getName() override { return "Leaky Relu layer"; }
-
-    NNLayerValues calculateActivationToAccumulationGradient(const NNLayerValues& in) override {
-        NNLayerValues results(getSize());
-        for(size_t i = 0; i < getSize(); ++i) {
-            results[i] = in[i] * (pre_values[i] > 0 ? 1.0f : 0.01f);
-        }
-        return results;
-    }
+    TanHLayer(size_t size, bool has_bias = true) : DenseLayer(size, has_bias) { }
 };
 
-class RampLayer : public NNLayer {
+
+class LinearLayer : public DenseLayer<LinearActivation> {
     public:
-    RampLayer(size_t size, bool has_bias = true, float t1 = -1.0, float t2 = 1.0)
-        : NNLayer(size, has_bias), t1(t1), t2(t2) { }
-    void applyActivationFunction() override {
-        std::transform(pre_values.begin(), pre_values.end(), values.begin(), [this](float x) { return this->f(x); });
-    }
-    const char* getName() override { return "Ramp layer"; }
+    LinearLayer(size_t size, bool has_bias = true) : DenseLayer(size, has_bias) { }
+};
 
-    NNLayerValues calculateActivationToAccumulationGradient(const NNLayerValues& in) override {
-        NNLayerValues results(getSize());
-        for(size_t i = 0; i < getSize(); ++i) {
-            results[i] = fp(pre_values[i]) * in[i];
-        }
-        return results;
-    }
 
-    float f(float x) { if (x < t1) return 0; if (x < t2) return (x - t1)/(t2 - t1); return 1; }
-    float fp(float x) { if (x < t1) return 0; if (x < t2) return 1/(t2 - t1); return 0; }
+class LeakyRelu : public DenseLayer<LeakyReluActivation> {
+    public:
+    LeakyRelu(size_t size, bool has_bias = true) : DenseLayer(size, has_bias) { }
+};
 
-    float t1, t2;
+class RampLayer : public DenseLayer<RampActivation> {
+    public:
+    RampLayer(size_t size, bool has_bias = true, float t1 = -1.0, float t2 = 1.0)
+        : DenseLayer(size, has_bias, RampActivation{t1, t2}) { }
 };
@@ -6,40 +6,49 @@
 #include <cmath>
 #include "NNAliases.h"
 
+// calculated and expected are n values each, the pointer versions
+// write into buffers of the caller and never allocate
 class NNLossFun {
 public:
-    virtual float calculateError(NNLayerValues calculated, NNLayerValues expected) = 0;
-    virtual NNLayerValues calculateDerivative(NNLayerValues calculated, NNLayerValues expected) = 0;
+    virtual float calculateError(const float* calculated, const float* expected, size_t n) = 0;
+    virtual void calculateDerivative(const float* calculated, const float* expected, float* out, size_t n) = 0;
     virtual const char* getName() = 0;
-    virtual NNLayerValues normalize(const NNLayerValues&) = 0;
+    virtual void normalize(const float* calculated, float* out, size_t n) = 0;
+
+    float calculateError(const NNLayerValues& calculated, const NNLayerValues& expected) {
+        return calculateError(calculated.data(), expected.data(), calculated.size());
+    }
+    NNLayerValues calculateDerivative(const NNLayerValues& calculated, const NNLayerValues& expected) {
+        NNLayerValues result(calculated.size());
+        calculateDerivative(calculated.data(), expected.data(), result.data(), calculated.size());
+        return result;
+    }
+    NNLayerValues normalize(const NNLayerValues& calculated) {
+        NNLayerValues result(calculated.size());
+        normalize(calculated.data(), result.data(), calculated.size());
+        return result;
+    }
 };
 
 class MeanSquaredLossFun : public NNLossFun{
 public:
     const char* getName() override { return "Square mean"; }
-    float calculateError(NNLayerValues calculated, NNLayerValues expected) override {
-        NNLayerValues& ye = expected;
-        NNLayerValues& yc = calculated;
+    float calculateError(const float* yc, const float* ye, size_t n) override {
         float result = 0;
-        for (size_t i = 0; i < yc.size(); ++i) {
+        for (size_t i = 0; i < n; ++i) {
             float diff = yc[i] - ye[i];
             result += diff * diff;
         }
         return result / 2;
     }
-    NNLayerValues calculateDerivative(NNLayerValues calculated, NNLayerValues expected) override {
-        NNLayerValues& ye = expected;
-        NNLayerValues& yc = calculated;
-        NNLayerValues result( calculated.size() );
-        for (size_t i = 0; i < calculated.size(); ++i) {
+    void calculateDerivative(const float* yc, const float* ye, float* result, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
             result[i] = yc[i] - ye[i];//TOTO;
         }
-
-        return result;
     }
 
-    NNLayerValues normalize(const NNLayerValues& v) override {
-        return v;
+    void normalize(const float* calculated, float* out, size_t n) override {
+        std::copy(calculated, calculated + n, out);
     }
 };
 
@@ -47,38 +56,33 @@ class LogLoss : public NNLossFun{
 public:
     const char* getName() override { return "Log Loss"; }
 
-    NNLayerValues normalize(const NNLayerValues& calculated) override{
-        NNLayerValues yc = calculated;
-        float D = - *std::max_element(yc.begin(), yc.end());
-        std::transform(yc.begin(), yc.end(), yc.begin(), [=](float f) { return std::exp(f + D); });
-        float sum_of_exps = std::accumulate(yc.begin(), yc.end(), 0.0f);
-        std::transform(yc.begin(), yc.end(), yc.begin(), [=](float f) { return f / sum_of_exps; });
-        return yc;
+    // softmax
+    void normalize(const float* calculated, float* out, size_t n) override {
+        float D = - *std::max_element(calculated, calculated + n);
+        std::transform(calculated, calculated + n, out, [=](float f) { return std::exp(f + D); });
+        float sum_of_exps = std::accumulate(out, out + n, 0.0f);
+        std::transform(out, out + n, out, [=](float f) { return f / sum_of_exps; });
     }
 
-    float calculateError(NNLayerValues calculated, NNLayerValues expected) override {
-        NNLayerValues& ye = expected;
-        NNLayerValues& yc = calculated;
+    float calculateError(const float* calculated, const float* ye, size_t n) override {
+        // softmax on the fly, so no buffer is needed
+        float D = - *std::max_element(calculated, calculated + n);
+        float sum_of_exps = 0.0f;
+        for (size_t i = 0; i < n; ++i) sum_of_exps += std::exp(calculated[i] + D);
 
-        yc = normalize(yc);
-
-        NNLayerValues res_v(yc.size());
-        for (size_t i = 0; i < yc.size(); ++i) {
-            res_v[i] = -ye[i] * log(yc[i]);
+        float result = 0.0f;
+        for (size_t i = 0; i < n; ++i) {
+            float yc = std::exp(calculated[i] + D) / sum_of_exps;
+            float res = -ye[i] * log(yc);
+            result += res;
         }
-        float result = std::accumulate(res_v.begin(), res_v.end(), 0.0f);
         if (!std::isfinite(result)) result = 0;
         return result;
     }
-    NNLayerValues calculateDerivative(NNLayerValues calculated, NNLayerValues expected) override {
-        NNLayerValues& ye = expected;
-        NNLayerValues& yc = calculated;
-
-        yc = normalize(yc);
-        NNLayerValues res(yc.size());
-        for (size_t i = 0; i < yc.size(); ++i) {
-            res[i] = yc[i] - ye[i];
+    void calculateDerivative(const float* calculated, const float* ye, float* res, size_t n) override {
+        normalize(calculated, res, n);
+        for (size_t i = 0; i < n; ++i) {
+            res[i] -= ye[i];
         }
-        return res;
     }
 };
\ No newline at end of file
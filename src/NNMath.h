@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+#include "NNGemm.h"
+#include "NNMatrix.h"
+
+// Matrix products used by the layers, thin wrappers over gemm.
+// Shapes of the outputs are adjusted, their padding stays zero.
+
+// c = a^T * b, or c += a^T * b when accumulating
+// a is [samples][out], b is [samples][in], c ends up as [out][in],
+// which is how the gradient of edges is laid out
+inline void multiplyAtB(const NNMatrix& a, const NNMatrix& b, NNMatrix& c, bool accumulate = false) {
+    assert(a.rows() == b.rows());
+    if (accumulate) assert(c.rows() == a.cols() && c.cols() == b.cols());
+    else c.setShape(a.cols(), b.cols());
+    gemm(true, false, a.cols(), b.cols(), a.rows(),
+         1.0f, a.data(), a.stride(), b.data(), b.stride(),
+         accumulate ? 1.0f : 0.0f, c.data(), c.stride());
+}
+
+// c = a * b
+// a is [samples][out], b is [out][in], c ends up as [samples][in]
+inline void multiplyAB(const NNMatrix& a, const NNMatrix& b, NNMatrix& c) {
+    assert(a.cols() == b.rows());
+    c.setShape(a.rows(), b.cols());
+    gemm(false, false, a.rows(), b.cols(), a.cols(),
+         1.0f, a.data(), a.stride(), b.data(), b.stride(),
+         0.0f, c.data(), c.stride());
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+
+// Dense row-major float matrix kept in a single 64-byte aligned buffer.
+// Every row is padded up to a whole number of cache lines, so each row
+// starts aligned and SIMD loops never have to peel. The padding is always
+// kept at zero, which lets element-wise kernels run over the whole buffer.
+class NNMatrix {
+public:
+    static constexpr size_t alignment = 64;
+    static constexpr size_t row_alignment = alignment / sizeof(float);
+
+    NNMatrix() = default;
+    NNMatrix(size_t rows, size_t cols) { resize(rows, cols); }
+
+    NNMatrix(const NNMatrix& other) { *this = other; }
+    NNMatrix(NNMatrix&& other) noexcept { swap(other); }
+
+    // reuses the buffer when it is big enough, so snapshots of a network
+    // with the same shape are a single memcpy per matrix
+    NNMatrix& operator=(const NNMatrix& other) {
+        if (this == &other) return *this;
+        reshape(other.rows_, other.cols_);
+        if (bufferSize() > 0)
+            std::memcpy(buffer.get(), other.buffer.get(), bufferSize() * sizeof(float));
+        return *this;
+    }
+    NNMatrix& operator=(NNMatrix&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    void swap(NNMatrix& other) noexcept {
+        std::swap(buffer, other.buffer);
+        std::swap(capacity, other.capacity);
+        std::swap(rows_, other.rows_);
+        std::swap(cols_, other.cols_);
+        std::swap(stride_, other.stride_);
+    }
+
+    // changes the shape, the contents are zeroed
+    void resize(size_t rows, size_t cols) {
+        reshape(rows, cols);
+        setZero();
+    }
+
+    // like resize, but keeps the contents when the shape already matches,
+    // for scratch matrices that get fully overwritten anyway
+    void setShape(size_t rows, size_t cols) {
+        if (rows != rows_ || cols != cols_) resize(rows, cols);
+    }
+
+    // changes the number of rows, keeps the contents of the rows that stay,
+    // new rows are zero
+    void resizeRows(size_t rows) {
+        if (rows > rows_ && rows * stride_ > capacity) {
+            NNMatrix grown(rows, cols_);
+            if (bufferSize() > 0)
+                std::memcpy(grown.data(), data(), bufferSize() * sizeof(float));
+            swap(grown);
+            return;
+        }
+        size_t old_size = bufferSize();
+        rows_ = rows;
+        if (bufferSize() > old_size)
+            std::memset(buffer.get() + old_size, 0, (bufferSize() - old_size) * sizeof(float));
+    }
+
+    void setZero() {
+        if (bufferSize() > 0)
+            std::memset(buffer.get(), 0, bufferSize() * sizeof(float));
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t stride() const { return stride_; }   // distance between rows, in floats
+    size_t bufferSize() const { return rows_ * stride_; } // including padding
+    bool empty() const { return rows_ == 0 || cols_ == 0; }
+
+    float* data() { return buffer.get(); }
+    const float* data() const { return buffer.get(); }
+
+    float* operator[](size_t row) {
+        assert(row < rows_);
+        return buffer.get() + row * stride_;
+    }
+    const float* operator[](size_t row) const {
+        assert(row < rows_);
+        return buffer.get() + row * stride_;
+    }
+
+    static size_t paddedStride(size_t cols) {
+        return (cols + row_alignment - 1) / row_alignment * row_alignment;
+    }
+
+private:
+    struct AlignedDeleter {
+        void operator()(float* p) const {
+            ::operator delete[](p, std::align_val_t{alignment});
+        }
+    };
+
+    // changes the shape without touching the contents of the buffer
+    void reshape(size_t rows, size_t cols) {
+        size_t stride = paddedStride(cols);
+        size_t needed = rows * stride;
+        if (needed > capacity) {
+            buffer.reset(static_cast<float*>(
+                ::operator new[](needed * sizeof(float), std::align_val_t{alignment})));
+            capacity = needed;
+        }
+        rows_ = rows;
+        cols_ = cols;
+        stride_ = stride;
+    }
+
+    std::unique_ptr<float[], AlignedDeleter> buffer;
+    size_t capacity = 0;
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    size_t stride_ = 0;
+};
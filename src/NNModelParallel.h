@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "NeuralNetwork.h"
+#include "NNMatrix.h"
+#include "NNThreadPool.h"
+#include "simd/NNSimd.h"
+
+// Intra-layer model parallelism (Megatron-LM style, Shoeybi et al. 2019):
+// the neurons of a wide layer are split into shards, one task each. The
+// connection into the layer is row-major by neuron, so a shard only ever
+// walks its own block of rows of it. The shards run pinned to the workers
+// of the pool (runPinned), shard s on the same worker every step, so its
+// block stays in the cache of that core from one step to the next instead
+// of every thread streaming the whole matrix. That is about caches only:
+// the connection is a single allocation of the network, on the NUMA node
+// of whoever touched it first, the parts of the gradient of the previous
+// layer (one matrix per shard) are first touched by their shard.
+// Forward: every shard puts the values of its neurons straight into their
+// columns of the values of the layer. Shards start at whole cache lines,
+// so this gather costs nothing and no two shards write the same line.
+// Backward: every shard computes the gradient of its rows of the
+// connection in place and its part of the gradient of the previous layer
+// (every neuron contributes to all of it). The parts are then summed in
+// the order of the shards, the threads taking a share of the samples each.
+// Narrow layers are computed as usual, by one thread.
+// The batch is not split, so this is worth it for few wide layers and
+// small batches, where splitting the batch leaves threads idle.
+class NNModelParallel {
+public:
+    // splits the layers of network with at least min_width neurons into
+    // (at most) shards shards of about the same size
+    void partition(const NeuralNetwork& network, size_t shards, size_t min_width) {
+        shard_begin.assign(network.layers.size(), {});
+        for (size_t l = 1; l < network.layers.size(); ++l) {
+            size_t size = network.layers[l]->getSize();
+            if (size < std::max<size_t>(min_width, 2)) continue;
+            // in whole cache lines of a row of values
+            size_t lines = (size + NNMatrix::row_alignment - 1) / NNMatrix::row_alignment;
+            size_t count = std::min(shards, lines);
+            if (count < 2) continue;
+            for (size_t s = 0; s < count; ++s)
+                shard_begin[l].push_back(s * lines / count * NNMatrix::row_alignment);
+            shard_begin[l].push_back(size);
+        }
+    }
+
+    // shards of layer l, 0 when it is not split
+    size_t shardCount(size_t l) const {
+        return l < shard_begin.size() && !shard_begin[l].empty() ? shard_begin[l].size() - 1 : 0;
+    }
+
+    // the same as network.evaluateBatch(ws.input, ws)
+    void evaluateBatch(const NeuralNetwork& network, NNWorkspace& ws) const {
+        assert(shard_begin.size() == network.layers.size());
+        network.evaluateLayers(ws, 0, 1);
+        for (size_t l = 1; l < network.layers.size(); ++l) {
+            const NNLayer& layer = *network.layers[l];
+            const NNMatrix& prev_values = ws.layers[l - 1].values;
+            size_t shards = shardCount(l);
+            if (shards == 0) {
+                layer.calculateBatchValues(prev_values, network.connections[l - 1], ws.layers[l]);
+                continue;
+            }
+            layer.prepareBatchValues(prev_values.rows(), ws.layers[l]);
+            NNThreadPool::global().runPinned(shards, [&](size_t s) {
+                layer.calculateBatchValuesPart(prev_values, network.connections[l - 1],
+                                               shard_begin[l][s], shard_begin[l][s + 1],
+                                               ws.layers[l]);
+            });
+        }
+    }
+
+    // the same as network.gradientDescentBatch(ws, gradients, accumulate),
+    // for the batch evaluated last with ws
+    void gradientDescentBatch(const NeuralNetwork& network, NNWorkspace& ws,
+                              std::vector<NNEdgeMatrix>& gradients, bool accumulate = false) {
+        assert(shard_begin.size() == network.layers.size());
+        assert(gradients.size() == network.connections.size());
+        for (size_t l = network.layers.size(); l-- > 1;) {
+            size_t shards = shardCount(l);
+            if (shards == 0) {
+                network.gradientDescentLayers(ws, gradients, l, l + 1, accumulate);
+                continue;
+            }
+            const NNLayer& layer = *network.layers[l];
+            NNMatrix& prev_gradient = ws.layers[l - 1].gradient;
+            if (partial_gradients.size() < shards - 1) partial_gradients.resize(shards - 1);
+            layer.prepareBatchDelta(ws.layers[l]);
+            // the first shard writes its part where the sum goes
+            NNThreadPool::global().runPinned(shards, [&](size_t s) {
+                layer.backwardPropagationBatchPart(
+                    ws.layers[l - 1].values, network.connections[l - 1],
+                    shard_begin[l][s], shard_begin[l][s + 1], ws.layers[l], gradients[l - 1],
+                    s == 0 ? prev_gradient : partial_gradients[s - 1], accumulate);
+            });
+            reducePartialGradients(shards, prev_gradient);
+        }
+    }
+
+private:
+    // prev_gradient += the parts of the shards but the first, in order,
+    // the rows are split between the threads
+    void reducePartialGradients(size_t shards, NNMatrix& prev_gradient) const {
+        const NNSimdKernels& kernels = simd();
+        size_t stride = prev_gradient.stride();
+        size_t grain = std::max<size_t>(16384 / std::max<size_t>(stride * shards, 1), 1);
+        NNThreadPool::global().parallelFor(0, prev_gradient.rows(), grain, [&](size_t first, size_t last) {
+            for (size_t s = 1; s < shards; ++s) {
+                const NNMatrix& part = partial_gradients[s - 1];
+                assert(part.bufferSize() == prev_gradient.bufferSize());
+                kernels.axpy(1.0f, part.data() + first * stride,
+                             prev_gradient.data() + first * stride, (last - first) * stride);
+            }
+        });
+    }
+
+    // per layer the first neuron of every shard, then the size of the layer,
+    // empty for the layers that are not split
+    std::vector<std::vector<size_t>> shard_begin;
+    std::vector<NNMatrix> partial_gradients; // of the previous layer, of the shards but the first
+};
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cmath>
+#include <string>
+#include <vector>
+
 #include "NNAliases.h"
 
 
@@ -15,33 +19,32 @@ public:
         : learning_rate{learning_rate},
           gradient_threshold{gradient_threshold}{}
     void applyMomentum(std::vector<NNEdgeMatrix>& matrices) override {
+        // padding of the matrices is zero, so it is safe to walk
+        // the whole buffers, it does not change any of the sums below
+
         // first, apply learning rate
         for (auto& m : matrices)
-        for (auto& r : m)
-        for (auto& c : r)
-            c *= -learning_rate;
+        for (float* c = m.data(); c != m.data() + m.bufferSize(); ++c)
+            *c *= -learning_rate;
 
         // then, replace all NaNs with 0s
         for (auto& m : matrices)
-        for (auto& r : m)
-        for (auto& c : r)
-            if (!std::isfinite(c))
-                c = 0;
+        for (float* c = m.data(); c != m.data() + m.bufferSize(); ++c)
+            if (!std::isfinite(*c))
+                *c = 0;
 
         float gradient_norm = 0.0f;
         for (auto& m : matrices)
-        for (auto& r : m)
-        for (auto& c : r)
-            gradient_norm += c*c;
+        for (float* c = m.data(); c != m.data() + m.bufferSize(); ++c)
+            gradient_norm += *c * *c;
 
         // Then, try to clip gradient
         https://arxiv.org/pdf/1211.5063.pdf
 
         if (gradient_norm > gradient_threshold)
         for (auto& m : matrices)
-        for (auto& r : m)
-        for (auto& c : r)
-            c = c * gradient_threshold / gradient_norm;
+        for (float* c = m.data(); c != m.data() + m.bufferSize(); ++c)
+            *c = *c * gradient_threshold / gradient_norm;
 
     }
 
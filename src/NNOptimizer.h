@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "NNAliases.h"
+#include "simd/NNSimd.h"
+
+// Applies the gradient to the weights, an alternative to NNMomentum +
+// adding the matrices. Does what NNSteadyLearningRate does (learning rate,
+// NaN scrub, clipping) plus the update rule, in two passes over the weights:
+// one reading the gradient to get its norm for clipping, one doing the rest.
+// Gradients are replaced with the change made to the weights.
+class NNOptimizer {
+public:
+    NNOptimizer(float learning_rate, float gradient_threshold)
+        : learning_rate{learning_rate},
+          gradient_threshold{gradient_threshold} {}
+    virtual ~NNOptimizer() = default;
+
+    void applyGradient(std::vector<NNEdgeMatrix>& gradients, std::vector<NNEdgeMatrix>& weights) {
+        assert(gradients.size() == weights.size());
+        const NNSimdKernels& kernels = simd();
+
+        // padding of the matrices is zero, so the whole buffers are walked
+        float gradient_norm = 0.0f;
+        for (auto& m : gradients)
+            gradient_norm += kernels.gradient_norm(m.data(), m.bufferSize(), learning_rate);
+
+        // https://arxiv.org/pdf/1211.5063.pdf
+        NNOptimizerStep step = parameters();
+        step.learning_rate = learning_rate;
+        if (gradient_norm > gradient_threshold)
+            step.clip = gradient_threshold / gradient_norm;
+
+        for (size_t i = 0; i < gradients.size(); ++i) {
+            assert(gradients[i].bufferSize() == weights[i].bufferSize());
+            update(kernels, step, i, gradients[i], weights[i]);
+        }
+    }
+
+    virtual std::string toString() {
+        return "Learning rate: " + std::to_string(learning_rate)
+        + ", gradient threshold: " + std::to_string(gradient_threshold);
+    }
+
+protected:
+    // update rule specific parameters of the step
+    virtual NNOptimizerStep parameters() { return {}; }
+    virtual void update(const NNSimdKernels& kernels, const NNOptimizerStep& step,
+                        size_t id, NNEdgeMatrix& gradient, NNEdgeMatrix& weights) = 0;
+
+    // state of the update rule for the matrix id, one float per weight,
+    // starts at zero
+    NNMatrix& state(size_t id, const NNEdgeMatrix& weights) {
+        if (states.size() <= id) states.resize(id + 1);
+        states[id].setShape(weights.rows(), weights.cols());
+        return states[id];
+    }
+
+    float learning_rate;
+    float gradient_threshold;
+
+private:
+    std::vector<NNMatrix> states;
+};
+
+class NNSgdOptimizer : public NNOptimizer {
+public:
+    NNSgdOptimizer(float learning_rate = 0.05, float gradient_threshold = 1.0)
+        : NNOptimizer(learning_rate, gradient_threshold) {}
+
+    std::string toString() override {
+        return "SGD, " + NNOptimizer::toString();
+    }
+
+protected:
+    void update(const NNSimdKernels& kernels, const NNOptimizerStep& step,
+                size_t, NNEdgeMatrix& gradient, NNEdgeMatrix& weights) override {
+        kernels.sgd_step(gradient.data(), weights.data(), weights.bufferSize(), step);
+    }
+};
+
+// classical momentum, the change is v = momentum * v - learning_rate * gradient
+class NNMomentumOptimizer : public NNOptimizer {
+public:
+    NNMomentumOptimizer(float learning_rate = 0.05, float momentum = 0.9, float gradient_threshold = 1.0)
+        : NNOptimizer(learning_rate, gradient_threshold), momentum{momentum} {}
+
+    std::string toString() override {
+        return "Momentum " + std::to_string(momentum) + ", " + NNOptimizer::toString();
+    }
+
+protected:
+    NNOptimizerStep parameters() override {
+        NNOptimizerStep step;
+        step.momentum = momentum;
+        return step;
+    }
+    void update(const NNSimdKernels& kernels, const NNOptimizerStep& step,
+                size_t id, NNEdgeMatrix& gradient, NNEdgeMatrix& weights) override {
+        kernels.momentum_step(gradient.data(), weights.data(), state(id, weights).data(),
+                              weights.bufferSize(), step);
+    }
+
+    float momentum;
+};
+
+// Nesterov momentum, v as above, the change looks ahead by one more step:
+// momentum * v - learning_rate * gradient
+class NNNesterovOptimizer : public NNMomentumOptimizer {
+public:
+    NNNesterovOptimizer(float learning_rate = 0.05, float momentum = 0.9, float gradient_threshold = 1.0)
+        : NNMomentumOptimizer(learning_rate, momentum, gradient_threshold) {}
+
+    std::string toString() override {
+        return "Nesterov " + std::to_string(momentum) + ", " + NNOptimizer::toString();
+    }
+
+protected:
+    void update(const NNSimdKernels& kernels, const NNOptimizerStep& step,
+                size_t id, NNEdgeMatrix& gradient, NNEdgeMatrix& weights) override {
+        kernels.nesterov_step(gradient.data(), weights.data(), state(id, weights).data(),
+                              weights.bufferSize(), step);
+    }
+};
+
+// RMSProp, the step is divided by the running RMS of the gradient:
+// m = decay * m + (1 - decay) * gradient^2,
+// the change is -learning_rate * gradient / (sqrt(m) + epsilon)
+class NNRMSPropOptimizer : public NNOptimizer {
+public:
+    NNRMSPropOptimizer(float learning_rate = 0.001, float decay = 0.9,
+                       float epsilon = 1e-8, float gradient_threshold = 1.0)
+        : NNOptimizer(learning_rate, gradient_threshold), decay{decay}, epsilon{epsilon} {
+            assert(epsilon > 0); // the padding has zero gradient
+        }
+
+    std::string toString() override {
+        return "RMSProp " + std::to_string(decay) + ", " + NNOptimizer::toString();
+    }
+
+protected:
+    NNOptimizerStep parameters() override {
+        NNOptimizerStep step;
+        step.decay = decay;
+        step.epsilon = epsilon;
+        return step;
+    }
+    void update(const NNSimdKernels& kernels, const NNOptimizerStep& step,
+                size_t id, NNEdgeMatrix& gradient, NNEdgeMatrix& weights) override {
+        kernels.rmsprop_step(gradient.data(), weights.data(), state(id, weights).data(),
+                             weights.bufferSize(), step);
+    }
+
+    float decay;
+    float epsilon;
+};
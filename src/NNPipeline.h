@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "NeuralNetwork.h"
+#include "NNThreadPool.h"
+
+// Pipeline-parallel propagation of a batch (GPipe style, Huang et al.
+// 2019): the layers are split into stages of about the same work and the
+// batch into micro-batches. The schedule is GPipe's fill and drain, not an
+// interleaved one (1F1B): all the forward passes first, micro-batch m in
+// stage s at tick m + s, then all the backward passes from the last stage
+// the same way. A tick is a fork-join, the stages busy in it run as tasks
+// of the thread pool and the next tick starts when all of them are done,
+// so the stages overlap within a tick and not across ticks; the pipeline
+// is only full (all the stages busy) between the first stages - 1 ticks
+// and the last ones, and a tick lasts as long as its slowest stage.
+// Worth it for deep and narrow networks, whose gemms are too small to
+// split the batch between threads. Every stage sums the gradients of its
+// connections over the micro-batches in their order, so the result is the
+// same as that of a single thread going through the micro-batches.
+class NNPipeline {
+public:
+    // groups the layers of network into (at most) stages stages,
+    // cutting where the sums of the connection sizes are even
+    void partition(const NeuralNetwork& network, size_t stages) {
+        size_t layer_count = network.layers.size();
+        size_t total = 0;
+        for (auto& c : network.connections) total += c.rows() * c.cols();
+        stages = std::max<size_t>(std::min(stages, layer_count - 1), 1);
+
+        stage_begin.clear();
+        stage_begin.push_back(0);
+        size_t done = 0;
+        for (size_t l = 1; l + 1 < layer_count && stage_begin.size() < stages; ++l) {
+            done += network.connections[l - 1].rows() * network.connections[l - 1].cols();
+            if (done * stages >= total * stage_begin.size()) stage_begin.push_back(l + 1);
+        }
+        stage_begin.push_back(layer_count);
+    }
+
+    size_t stageCount() const { return stage_begin.empty() ? 0 : stage_begin.size() - 1; }
+
+    // forward and backward pass of micro_batches micro-batches, gradients
+    // of the connections are summed over all of them into gradients
+    //   input(m, ws)  puts the inputs of micro-batch m into ws.input
+    //   loss(m, ws)   puts the gradient of the loss into ws.outputGradient(),
+    //                 from the outputs in ws.outputValues()
+    template <typename Input, typename Loss>
+    void run(const NeuralNetwork& network, size_t micro_batches,
+             std::vector<NNEdgeMatrix>& gradients, const Input& input, const Loss& loss) {
+        assert(!stage_begin.empty() && stage_begin.back() == network.layers.size());
+        if (micro_batches == 0) return;
+        size_t stages = stageCount();
+        // a workspace per micro-batch, they are all in flight at once
+        if (workspaces.size() < micro_batches) workspaces.resize(micro_batches);
+        for (size_t m = 0; m < micro_batches; ++m)
+            if (workspaces[m].layers.size() != network.layers.size())
+                workspaces[m] = network.makeWorkspace();
+
+        size_t ticks = micro_batches + stages - 1;
+        for (size_t tick = 0; tick < ticks; ++tick) {
+            // stage s works on micro-batch tick - s
+            size_t first = tick < micro_batches ? 0 : tick - micro_batches + 1;
+            size_t last = std::min(tick, stages - 1);
+            NNThreadPool::global().run(last - first + 1, [&](size_t i) {
+                size_t s = first + i;
+                size_t m = tick - s;
+                NNWorkspace& ws = workspaces[m];
+                if (s == 0) input(m, ws);
+                network.evaluateLayers(ws, stage_begin[s], stage_begin[s + 1]);
+                if (s == stages - 1) loss(m, ws);
+            });
+        }
+        for (size_t tick = 0; tick < ticks; ++tick) {
+            // the same from the last stage, stage s works on micro-batch
+            // tick - (stages - 1 - s)
+            size_t first = tick < micro_batches ? 0 : tick - micro_batches + 1;
+            size_t last = std::min(tick, stages - 1);
+            NNThreadPool::global().run(last - first + 1, [&](size_t i) {
+                size_t s = stages - 1 - (first + i);
+                size_t m = tick - (first + i);
+                network.gradientDescentLayers(workspaces[m], gradients,
+                                              stage_begin[s], stage_begin[s + 1], m > 0);
+            });
+        }
+    }
+
+private:
+    std::vector<size_t> stage_begin; // first layer of every stage, then the layer count
+    std::vector<NNWorkspace> workspaces;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// What a stream of random numbers is used for, streams of different uses
+// (and different indices) never overlap.
+enum class NNRandomStream : uint32_t {
+    global = 0,
+    weights = 1, // index is the connection matrix
+    shuffle = 2, // index is the epoch
+};
+
+// Counter-based generator, Philox4x32-10 (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3", SC'11). Number n of a stream is a pure
+// function of (seed, stream, n): there is no state to share, so any
+// thread can make its own stream, or jump to any position of one, and
+// get the same numbers as everybody else would.
+// Usable as the URBG of the std algorithms and distributions.
+class NNRandom {
+public:
+    using result_type = uint32_t;
+
+    explicit NNRandom(uint64_t seed_value = 123,
+                      NNRandomStream use = NNRandomStream::global, uint32_t index = 0)
+        : key{static_cast<uint32_t>(seed_value), static_cast<uint32_t>(seed_value >> 32)},
+          stream_use{static_cast<uint32_t>(use)}, stream_index{index} {}
+
+    void seed(uint64_t seed_value) {
+        *this = NNRandom(seed_value, static_cast<NNRandomStream>(stream_use), stream_index);
+    }
+    uint64_t getSeed() const { return key[0] | static_cast<uint64_t>(key[1]) << 32; }
+
+    // another stream with the same seed, starting at its beginning
+    NNRandom stream(NNRandomStream use, uint32_t index = 0) const {
+        return NNRandom(getSeed(), use, index);
+    }
+
+    // the next number is number n of the stream
+    void seek(uint64_t n) { position = n; }
+    void discard(uint64_t n) { position += n; }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+
+    result_type operator()() {
+        uint64_t block_index = position / 4;
+        if (block_index != cached_block) {
+            uint32_t counter[4] = {static_cast<uint32_t>(block_index),
+                                   static_cast<uint32_t>(block_index >> 32),
+                                   stream_use, stream_index};
+            philox(counter, key, block);
+            cached_block = block_index;
+        }
+        return block[position++ % 4];
+    }
+
+    // uniform in [0, 1), 24 bits, the same on every platform
+    // (unlike std::uniform_real_distribution)
+    float uniform() {
+        return static_cast<float>((*this)() >> 8) * (1.0f / 16777216.0f);
+    }
+    float uniform(float low, float high) {
+        return low + (high - low) * uniform();
+    }
+
+    // the 10 rounds of Philox4x32 on one counter, 4 numbers out
+    static void philox(const uint32_t counter[4], const uint32_t key_in[2], uint32_t out[4]) {
+        uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        uint32_t k0 = key_in[0], k1 = key_in[1];
+        for (int round = 0; round < 10; ++round) {
+            uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+            uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+            uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+            uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+            c1 = static_cast<uint32_t>(p1);
+            c3 = static_cast<uint32_t>(p0);
+            c0 = n0;
+            c2 = n2;
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+
+private:
+    uint32_t key[2];
+    uint32_t stream_use;
+    uint32_t stream_index;
+    uint64_t position = 0;
+    uint64_t cached_block = UINT64_MAX;
+    uint32_t block[4] = {};
+};
@@ -1,6 +1,12 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 #include <memory>
 #include <mutex>
@@ -11,10 +17,16 @@
 
 #include "utils.h"
 #include "DataPoint.h"
+#include "Dataset.h"
 #include "NeuralNetwork.h"
+#include "NNDistributed.h"
 #include "NNLossFun.h"
+#include "NNModelParallel.h"
 #include "NNMomentum.h"
+#include "NNOptimizer.h"
+#include "NNPipeline.h"
 #include "NNTerminator.h"
+#include "NNThreadPool.h"
 
 bool debug = false;
 
@@ -22,28 +34,54 @@ bool debug = false;
 // Contains a scheduler, a momentum keeper and a terminator of NN.
 class NNTeacher {
 public:
+    // samples shuffle_order[first .. last) of dataset, the part of a worker
+    // of a multi-process training may be empty
+    struct Batch {
+        size_t first = 0;
+        size_t last = 0;
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+    };
+
+    ~NNTeacher() {
+        try {
+            waitForTestError();
+        } catch (...) {
+        }
+    }
+
     void addNetwork(std::unique_ptr<NeuralNetwork> nn) {
+        waitForTestError();
         network = std::move(nn);
+        training_threads.clear();
+        chunk_gradients.clear();
+        test_workspaces.clear();
+        pipeline = NNPipeline();
+        model_parallel = NNModelParallel();
     }
     void addTerminator(std::unique_ptr<NNTerminator> term) {
         terminator = std::move(term);
     }
     void addLossFunction(std::unique_ptr<NNLossFun> loss) {
+        waitForTestError();
         loss_fun = std::move(loss);
     }
-    void addTrainingDataSet(std::vector<DataPoint> data) {
+    void addTrainingDataSet(Dataset data) {
+        waitForTestError();
         dataset = std::move(data);
+        shuffle_order.clear();
         if (dataset.empty()) return;
 
         DataPoint min_dp;
-        min_dp.input.resize(dataset[0].input.size());
-        min_dp.output.resize(dataset[0].output.size());
+        min_dp.input.resize(dataset.inputSize());
+        min_dp.output.resize(dataset.outputSize());
 
         DataPoint max_dp;
-        max_dp.input.resize(dataset[0].input.size());
-        max_dp.output.resize(dataset[0].output.size());
+        max_dp.input.resize(dataset.inputSize());
+        max_dp.output.resize(dataset.outputSize());
 
-        for (const auto& p : dataset) {
+        for (size_t row = 0; row < dataset.size(); ++row) {
+            auto p = dataset[row];
             for(size_t i = 0; i < p.input.size(); ++i) {
                 min_dp.input[i] = std::min(min_dp.input[i], p.input[i]);
                 max_dp.input[i] = std::max(max_dp.input[i], p.input[i]);
@@ -68,20 +106,23 @@ public:
         dataset_max = max_dp;
 
 
-        for (auto& p : dataset) {
-            normalizeDatapoint(p);
+        for (size_t row = 0; row < dataset.size(); ++row) {
+            normalizeDatapoint(dataset[row]);
         }
     }
 
-    void addTestingDataset(std::vector<DataPoint> data) {
+    void addTestingDataset(Dataset data) {
         assert(dataset.size() > 0);
+        waitForTestError();
         dataset_test = std::move(data);
-        for (auto& p : dataset_test) {
-            normalizeDatapoint(p);
+        for (size_t row = 0; row < dataset_test.size(); ++row) {
+            normalizeDatapoint(dataset_test[row]);
         }
     }
 
-    void normalizeDatapoint(DataPoint& p) {
+    // of a DataPoint or a row of a Dataset
+    template <typename Sample>
+    void normalizeDatapoint(Sample&& p) {
         for (size_t i = 0; i < p.input.size(); ++i) {
             p.input[i] -= dataset_min.input[i];
             p.input[i] /= (dataset_max.input[i] - dataset_min.input[i]);
@@ -92,7 +133,8 @@ public:
         }
     }
 
-    void denormalizeDatapoint(DataPoint& p) {
+    template <typename Sample>
+    void denormalizeDatapoint(Sample&& p) {
         for (size_t i = 0; i < p.input.size(); ++i) {
             p.input[i] *= (dataset_max.input[i] - dataset_min.input[i]);
             p.input[i] += dataset_min.input[i];
@@ -107,14 +149,28 @@ public:
     void addMomentum(std::unique_ptr<NNMomentum> mom) {
         momentum = std::move(mom);
     }
+    // used instead of the momentum when set
+    void addOptimizer(std::unique_ptr<NNOptimizer> opt) {
+        optimizer = std::move(opt);
+    }
+    // makes this a worker of a multi-process training (NNDistributed.h):
+    // every worker has the whole training set and the same seed, so the
+    // same order of every epoch, and computes its part of every batch
+    // (batch_size is the size of the whole batch); the gradients of the
+    // parts and the error of every epoch are summed over all the workers,
+    // so all of them take the steps a single process would. Hogwild never
+    // talks to the others, learnEpoch refuses the two together
+    void addCommunicator(std::unique_ptr<NNCommunicator> comm) {
+        communicator = std::move(comm);
+    }
 
+    // publish a copy of the network (or of its last changes) for the
+    // readers on other threads, see publish()
     void updateLast() {
-        std::lock_guard l(m);
-        this->last_readable->connections = network->connections;
+        publish(last_readable, spare_readable, network->connections);
     }
     void updateLastChange(const std::vector<NNEdgeMatrix>& grad) {
-        std::lock_guard l(m);
-        this->last_readable_changes->connections = grad;
+        publish(last_readable_changes, spare_readable_changes, grad);
     }
 
     bool hasNextBatch() {
@@ -128,107 +184,69 @@ public:
     void learnBatch() {
         if (batches.empty()) throw "woopsie";
         if (finished()) return;
-        std::vector<DataPoint> batch = std::move(batches.back());
+        Batch batch = batches.back();
         batches.pop_back();
 
-        std::vector<std::vector<NNEdgeMatrix>> gradients;
-
-        // backprop for all in batch
-        for (auto&& dp : batch) {
-            if (debug) {
-
-                std::cerr << "DP in : ";
-                for (float f : dp.input) std::cerr << f << " ";
-                std::cerr << std::endl;
-            }
-
-            network->evaluateNetwork(dp.input);
-
-            if (debug) {
-
-                std::cerr << "Network nodes:\n";
-                for (int i = 0; i < network->layers.size(); ++i) {
-                    auto && l = network->layers[i];
-                    std::cerr << "Layer " << i << " pre act:\n";
-                    for (float f : l->pre_values)
-                        std::cerr << std::setw(9) << std::fixed << std::setprecision(4) << f;
-                    std::cerr << "\nLayer " << i << " post act:\n";
-                    for (float f : l->values)
-                        std::cerr << std::setw(9) << std::setprecision(4) << f;
-                        std::cerr << "\n\n";
-                }
-
-
-                std::cerr << "DP out : ";
-                for (float f : dp.output) std::cerr << f << " ";
-                std::cerr << "\n";
-            }
-
-
-            auto network_ans= network->getLastLayerAfterEvaluation().values;
-
-            if (debug) {
-                std::cerr << "NN out : ";
-                for (float f : network_ans) std::cerr << f << " ";
-                std::cerr << "\n";
-            }
-
-            auto network_ans_cal = loss_fun->normalize(network_ans);
-
-            if (debug) {
-                std::cerr << "NN out norm: ";
-                for (float f : network_ans_cal) std::cerr << f << " ";
-                std::cerr << "\n";
-            }
-
-            auto err_der = loss_fun->calculateDerivative(network_ans, dp.output);
-
-            if (debug) {
-                std::cerr << "Err der : ";
-                for (float f : err_der) std::cerr << f << " ";
-                std::cerr << "\n";
-            }
-
-            auto err = loss_fun->calculateError(network_ans, dp.output);
-            error_history_epoch.push_back(err);
-            auto grad = network->gradientDescent(err_der);
-            gradients.push_back(std::move(grad));
-        }
-
-        auto addMatrices = [](const std::vector<NNEdgeMatrix>& v_in, std::vector<NNEdgeMatrix>& v_out) {
-            for (size_t matrix_id = 0; matrix_id < v_in.size(); ++matrix_id) {
-                const auto& m_in = v_in[matrix_id];
-                auto& m_out = v_out[matrix_id];
-                for (size_t row_id = 0; row_id < m_in.size(); ++ row_id) {
-                    const auto& row_in = m_in[row_id];
-                    auto& row_out = m_out[row_id];
-                    for (size_t col_id = 0; col_id < row_in.size(); ++col_id) {
-                        row_out[col_id] += row_in[col_id];
-                    }
+        // every sample has its place for its error in the epoch,
+        // whichever thread computes it
+        size_t errors_begin = error_history_epoch.size();
+        error_history_epoch.resize(errors_begin + batch.size());
+        float* errors = error_history_epoch.data() + errors_begin;
+
+        if (batch.empty()) {
+            // a batch smaller than the workers, see generateBatches()
+            for (auto& g : network->gradients) g.setZero();
+        } else if (pipeline_stages > 1) {
+            batchGradientPipelined(batch, errors);
+        } else if (layer_shards > 1) {
+            batchGradientModelParallel(batch, errors);
+        } else if (deterministic) {
+            batchGradientDeterministic(batch, errors);
+        } else {
+            // the batch is split into one contiguous shard per thread, each thread
+            // propagates its shard with its own workspace and gradients, the
+            // gradients are then summed pairwise into those of the network
+            size_t shards = shardCount(batch.size());
+            prepareThreads(shards);
+            NNThreadPool::global().run(shards, [&](size_t shard) {
+                size_t shard_begin = batch.first + shard * batch.size() / shards;
+                size_t shard_end = batch.first + (shard + 1) * batch.size() / shards;
+                // in parts of at most sub_batch_size samples, the gradients of the
+                // parts are summed straight into the gradient buffers of the thread,
+                // so memory does not grow with batch size
+                for (size_t first = shard_begin; first < shard_end; first += sub_batch_size) {
+                    size_t last = std::min(first + sub_batch_size, shard_end);
+                    accumulateGradient(threadWorkspace(shard), threadGradients(shard),
+                                       first, last, first > shard_begin, errors + (first - batch.first));
                 }
-            }
-        };
-
-        // Sum all gradients
-        std::vector<NNEdgeMatrix> grad_mean = gradients[0];
-        size_t M = batch.size();
-        for (size_t i = 1; i < M; ++i) {
-            addMatrices(gradients[i], grad_mean);
+            });
+            reduceGradients(shards, [this](size_t t) -> std::vector<NNEdgeMatrix>& {
+                return threadGradients(t);
+            });
         }
+        std::vector<NNEdgeMatrix>& grad_sum = network->gradients;
+        // the gradient of the whole batch, the parts of all the workers
+        if (communicator) ringAllReduce(*communicator, grad_sum);
 
         // reduce by size of batch (calulate mean)
-        // for (auto& matrix : grad_mean)
+        // for (auto& matrix : grad_sum)
         //     for (auto& row : matrix)
         //         for (auto& col : row)
         //            col /= M;
 
-        // apply momentum and learning factor
-        momentum->applyMomentum(grad_mean);
+        if (optimizer) {
+            // learning factor, clipping, update rule and the changes
+            // to the network, all fused
+            optimizer->applyGradient(grad_sum, network->connections);
+        } else {
+            // apply momentum and learning factor
+            momentum->applyMomentum(grad_sum);
 
-        // apply changes to the network
-        addMatrices(grad_mean, network->connections);
+            // apply changes to the network
+            addMatrices(grad_sum, network->connections);
+        }
         updateLast();
-        updateLastChange(grad_mean);
+        updateLastChange(grad_sum);
     }
 
     // starts a new epoch
@@ -238,22 +256,97 @@ public:
         last_version++;
         if (finished()) return;
         batches.clear();
-        std::shuffle(dataset.begin(), dataset.end(), RNG);
+        error_history_epoch.reserve(dataset.size());
+        network->workspace.reserve(std::max(std::min(batch_size, sub_batch_size), evaluation_batch_size));
+        // a stream per epoch, the order does not depend on what else was drawn
+        NNRandom random = RNG.stream(NNRandomStream::shuffle, static_cast<uint32_t>(epoch));
+        // only the indices of the rows are shuffled, the set stays where it
+        // is, the rows of a batch are gathered when it is computed; the order
+        // of the epoch before is shuffled, as the set itself used to be
+        assert(dataset.size() <= std::numeric_limits<uint32_t>::max());
+        if (shuffle_order.size() != dataset.size()) {
+            shuffle_order.resize(dataset.size());
+            std::iota(shuffle_order.begin(), shuffle_order.end(), uint32_t{0});
+        }
+        std::shuffle(shuffle_order.begin(), shuffle_order.end(), random);
+        // the batches are ranges of the order
         size_t i;
         for (i = 0; i + batch_size < dataset.size(); i += batch_size) {
-            batches.push_back(std::vector(dataset.begin() + i, dataset.begin() + i + batch_size));
+            batches.push_back({i, i + batch_size});
+        }
+        if (i != dataset.size())
+            batches.push_back({i, dataset.size()});
+        if (communicator) {
+            // the workers shuffled alike, each keeps its part of every batch
+            size_t rank = communicator->rank();
+            size_t workers = communicator->size();
+            for (Batch& batch : batches) {
+                size_t size = batch.size();
+                batch = {batch.first + rank * size / workers, batch.first + (rank + 1) * size / workers};
+            }
         }
-        if (dataset.begin() + i != dataset.end())
-            batches.push_back(std::vector(dataset.begin() + i, dataset.end()));
     }
 
     void learnEpoch() {
+        if (hogwild) {
+            learnEpochHogwild();
+            return;
+        }
         generateBatches();
         if (finished()) return;
         while (hasNextBatch()) learnBatch();
 
     }
 
+    // Asynchronous version of learnEpoch, Hogwild! style
+    // (https://arxiv.org/abs/1106.5730): every thread takes the next batch
+    // of the epoch, computes its gradient against the weights as they are
+    // right then and applies it straight to the shared weights, no locks,
+    // no reduction, no waiting for the others. The updates race (plain
+    // float stores, one may overwrite a part of another), which SGD
+    // tolerates well when the updates are small or touch few weights.
+    // Plain SGD with hogwild_learning_rate and gradient clipping, the
+    // momentum and the optimizer are not used (their state is not shared).
+    void learnEpochHogwild() {
+        // the racing updates of a worker are never summed with the others,
+        // the workers would drift apart and wait for each other forever
+        if (communicator)
+            throw std::logic_error("hogwild training with a communicator");
+        generateBatches();
+        if (finished() || batches.empty()) return;
+
+        size_t count = std::min(threadCount(), batches.size());
+        prepareThreads(count);
+        // the weights before the epoch, what the racing steps changed
+        // in it is published at the end
+        hogwild_start = network->connections;
+        // the error of every row of the set has its place
+        size_t errors_begin = error_history_epoch.size();
+        error_history_epoch.resize(errors_begin + dataset.size());
+        float* errors = error_history_epoch.data() + errors_begin;
+        std::atomic<size_t> next_batch{0};
+        NNThreadPool::global().run(count, [&](size_t t) {
+            for (size_t b; (b = next_batch++) < batches.size();) {
+                const Batch& batch = batches[b];
+                for (size_t first = batch.first; first < batch.last; first += sub_batch_size) {
+                    size_t last = std::min(first + sub_batch_size, batch.last);
+                    accumulateGradient(threadWorkspace(t), threadGradients(t),
+                                       first, last, first > batch.first, errors + first);
+                }
+                applyHogwildStep(threadGradients(t));
+            }
+        });
+        batches.clear();
+        for (size_t i = 0; i < hogwild_start.size(); ++i) {
+            float* change = hogwild_start[i].data();
+            const float* weights = network->connections[i].data();
+            for (size_t j = 0; j < hogwild_start[i].bufferSize(); ++j)
+                change[j] = weights[j] - change[j];
+        }
+        updateLast();
+        updateLastChange(hogwild_start);
+    }
+
     bool finished() {
         return stopped;
     }
@@ -263,52 +356,430 @@ public:
     }
 
     void checkFinish() {
-        float total_error;
-        if (error_history_epoch.size() == 0)
+        float total_error =
+            static_cast<float>(
+                std::accumulate(error_history_epoch.begin(),
+                                error_history_epoch.end(),
+                                0.0));
+        size_t samples = error_history_epoch.size();
+        if (communicator) {
+            // the error on all the shards, so all the workers stop together
+            float sums[2] = {total_error, static_cast<float>(samples)};
+            ringAllReduce(*communicator, sums, 2);
+            total_error = sums[0];
+            samples = static_cast<size_t>(sums[1]);
+        }
+        if (samples == 0)
             total_error = INFINITY;
-        else
-            total_error =
-                static_cast<float>(
-                    std::accumulate(error_history_epoch.begin(),
-                                    error_history_epoch.end(),
-                                    0.0));
 
         stopped = terminator->shouldFinish(total_error);
 
-        std::lock_guard l{m};
-        if (error_history_epoch.size() > 0) {
-            error_history.push_back(total_error);
-            if (dataset_test.empty()) error_history_test.push_back(NAN);
-            else {
-                float test_error = 0.0f;
-                for (const auto& dp : dataset_test) {
-                    network->evaluateNetwork(dp.input);
-                    auto nn_res = network->getLastLayerAfterEvaluation().values;
-                    auto err = loss_fun->calculateError(nn_res, dp.output);
-                    test_error +=err;
+        if (samples > 0) {
+            size_t index;
+            {
+                std::lock_guard l{m};
+                index = error_history.size();
+                error_history.push_back(total_error);
+                error_history_test.push_back(NAN); // until the evaluation is done
+                error_history_epoch.clear();
+            }
+            startTestEvaluation(index);
+            // the history is complete once the training is
+            if (stopped) waitForTestError();
+        }
+
+    }
+
+    // waits for the test error of the last epoch, see startTestEvaluation()
+    void waitForTestError() {
+        try {
+            test_evaluation.wait();
+        } catch (...) {
+            test_evaluation.reset();
+            throw;
+        }
+    }
+
+private:
+    // Swaps a new snapshot in place of the published one. Snapshots are
+    // never written to once published, so readers just take the pointer
+    // and use it without a lock (with a workspace of their own). The
+    // previous snapshots are kept as spares and recycled once no reader
+    // holds them anymore. A new one is made only when readers hold all of
+    // them, so there are at most as many as readers holding snapshots at
+    // once, plus one, and once there are enough publishing does not allocate.
+    void publish(std::shared_ptr<NeuralNetwork>& published,
+                 std::vector<std::shared_ptr<NeuralNetwork>>& spares,
+                 const std::vector<NNEdgeMatrix>& connections) {
+        std::shared_ptr<NeuralNetwork> next;
+        for (size_t i = 0; i < spares.size(); ++i) {
+            // only readers that already have it hold it, the count only drops
+            if (spares[i].use_count() == 1) {
+                // readers dropping it released their reads, see them before writing
+                std::atomic_thread_fence(std::memory_order_acquire);
+                std::swap(spares[i], spares.back());
+                next = std::move(spares.back());
+                spares.pop_back();
+                break;
+            }
+        }
+        if (!next) next = std::make_shared<NeuralNetwork>();
+        next->assignParameters(network->layers, connections);
+        {
+            std::lock_guard l(m);
+            std::swap(published, next);
+        }
+        if (next) spares.push_back(std::move(next));
+    }
+
+    // Scratch of a training thread other than the first one, which works
+    // in the buffers of the network (so a single thread does what it
+    // always did).
+    struct TrainingThread {
+        NNWorkspace workspace;
+        std::vector<NNEdgeMatrix> gradients;
+    };
+
+    NNWorkspace& threadWorkspace(size_t t) {
+        return t == 0 ? network->workspace : training_threads[t - 1].workspace;
+    }
+    std::vector<NNEdgeMatrix>& threadGradients(size_t t) {
+        return t == 0 ? network->gradients : training_threads[t - 1].gradients;
+    }
+    // gradient of a chunk of the deterministic mode, the first one
+    // is that of the network, where the sum ends up
+    std::vector<NNEdgeMatrix>& chunkGradients(size_t c) {
+        return c == 0 ? network->gradients : chunk_gradients[c - 1];
+    }
+
+    // shards a batch is split into, small batches are not worth splitting
+    size_t shardCount(size_t samples) {
+        size_t worth = std::max<size_t>(samples / std::max<size_t>(min_samples_per_thread, 1), 1);
+        return std::min(threadCount(), worth);
+    }
+
+    size_t threadCount() {
+        return threads ? threads : NNThreadPool::global().size();
+    }
+
+    // buffers for the given number of threads, they take their shapes
+    // from the network, so they are made anew when it changes
+    void prepareThreads(size_t count) {
+        assert(count >= 1);
+        if (training_threads.size() < count - 1) training_threads.resize(count - 1);
+        for (size_t t = 1; t < count; ++t) {
+            TrainingThread& thread = training_threads[t - 1];
+            if (thread.workspace.layers.size() != network->workspace.layers.size()
+                || thread.gradients.size() != network->gradients.size()) {
+                thread.workspace = network->workspace;
+                thread.gradients = network->gradients;
+            }
+        }
+    }
+
+    // gradient buffers for the chunks of the deterministic mode
+    void prepareChunks(size_t count) {
+        assert(count >= 1);
+        if (chunk_gradients.size() < count - 1) chunk_gradients.resize(count - 1);
+        for (size_t c = 1; c < count; ++c)
+            if (chunk_gradients[c - 1].size() != network->gradients.size())
+                chunk_gradients[c - 1] = network->gradients;
+    }
+
+    // sums gradients(1) ... gradients(count - 1) into gradients(0), pairwise
+    // (a tree, log2 of count levels); the shape of the tree, and so the
+    // order of the additions, only depends on count
+    template <typename Gradients>
+    void reduceGradients(size_t count, const Gradients& gradients) {
+        for (size_t step = 1; step < count; step *= 2) {
+            size_t pairs = (count - step + 2 * step - 1) / (2 * step);
+            NNThreadPool::global().run(pairs, [&](size_t pair) {
+                size_t into = pair * 2 * step;
+                addMatrices(gradients(into + step), gradients(into));
+            });
+        }
+    }
+
+    // Gradient of a batch that is the same bit for bit whatever the number
+    // of threads: the batch is cut into chunks of deterministic_chunk_size
+    // samples, each chunk gets gradient buffers of its own (whichever thread
+    // takes it) and the chunks are summed by the same tree every time.
+    void batchGradientDeterministic(const Batch& batch, float* errors) {
+        size_t chunk_size = std::max<size_t>(deterministic_chunk_size, 1);
+        size_t chunks = (batch.size() + chunk_size - 1) / chunk_size;
+        size_t count = std::min(threadCount(), chunks);
+        prepareThreads(count);
+        prepareChunks(chunks);
+        std::atomic<size_t> next_chunk{0};
+        NNThreadPool::global().run(count, [&](size_t t) {
+            for (size_t c; (c = next_chunk++) < chunks;) {
+                size_t chunk_begin = batch.first + c * chunk_size;
+                size_t chunk_end = std::min(chunk_begin + chunk_size, batch.last);
+                for (size_t first = chunk_begin; first < chunk_end; first += sub_batch_size) {
+                    size_t last = std::min(first + sub_batch_size, chunk_end);
+                    accumulateGradient(threadWorkspace(t), chunkGradients(c),
+                                       first, last, first > chunk_begin, errors + (first - batch.first));
                 }
-                test_error /= dataset_test.size();
-                test_error *= dataset.size();
-                error_history_test.push_back(test_error);
             }
-            error_history_epoch.clear();
+        });
+        reduceGradients(chunks, [this](size_t c) -> std::vector<NNEdgeMatrix>& {
+            return chunkGradients(c);
+        });
+    }
+
+    // Fills in entry index of error_history_test, in the background: the
+    // test set is evaluated on the published snapshot of the weights (never
+    // written to) on the thread pool, while the next epoch is trained.
+    // One evaluation at a time, a new one waits for the one before. What
+    // else it needs of the teacher is taken by value, the training set and
+    // the loss function may be replaced while it runs.
+    void startTestEvaluation(size_t index) {
+        waitForTestError();
+        std::shared_ptr<const NeuralNetwork> snapshot = GetLastReadable();
+        if (dataset_test.empty() || !snapshot) {
+            std::lock_guard l{m};
+            test_errors_evaluated = index + 1;
+            return;
+        }
+        NNThreadPool::global().submit(test_evaluation,
+                                      [this, snapshot, index, training_size = dataset.size(),
+                                       loss = loss_fun] {
+            float test_error = testError(*snapshot, training_size, *loss);
+            std::lock_guard l{m};
+            error_history_test[index] = test_error;
+            test_errors_evaluated = index + 1;
+        });
+    }
+
+    // Gradient of a batch with the layers split into pipeline_stages groups,
+    // each working on another micro-batch of pipeline_micro_batch_size
+    // samples at the same time, see NNPipeline. Gives the same results
+    // whatever the number of threads too.
+    void batchGradientPipelined(const Batch& batch, float* errors) {
+        size_t micro_size = std::max<size_t>(pipeline_micro_batch_size, 1);
+        size_t micro_batches = (batch.size() + micro_size - 1) / micro_size;
+        pipeline.partition(*network, pipeline_stages);
+        pipeline.run(*network, micro_batches, network->gradients,
+            [&](size_t m, NNWorkspace& ws) {
+                size_t first = batch.first + m * micro_size;
+                size_t count = std::min(micro_size, batch.last - first);
+                gatherInputs(dataset, shuffle_order.data() + first, count, ws.input);
+            },
+            [&](size_t m, NNWorkspace& ws) {
+                lossGradient(ws, batch.first + m * micro_size, errors + m * micro_size);
+            });
+    }
+
+    // Gradient of a batch with the neurons of the wide layers (at least
+    // min_sharded_layer_size of them) split into layer_shards groups, which
+    // threads compute at once, see NNModelParallel. The batch goes through
+    // in parts of sub_batch_size samples, one after another.
+    void batchGradientModelParallel(const Batch& batch, float* errors) {
+        model_parallel.partition(*network, layer_shards, min_sharded_layer_size);
+        NNWorkspace& ws = network->workspace;
+        for (size_t first = batch.first; first < batch.last; first += sub_batch_size) {
+            size_t count = std::min(sub_batch_size, batch.last - first);
+            gatherInputs(dataset, shuffle_order.data() + first, count, ws.input);
+            model_parallel.evaluateBatch(*network, ws);
+            lossGradient(ws, first, errors + (first - batch.first));
+            model_parallel.gradientDescentBatch(*network, ws, network->gradients, first > batch.first);
         }
+    }
 
+    // error of net on the whole test set, scaled to training_size samples,
+    // the threads take parts of evaluation_batch_size samples, the errors
+    // of the samples are then summed in order, as a single thread would
+    float testError(const NeuralNetwork& net, size_t training_size, NNLossFun& loss) {
+        size_t part_size = std::max<size_t>(evaluation_batch_size, 1);
+        size_t parts = (dataset_test.size() + part_size - 1) / part_size;
+        size_t count = std::min(threadCount(), parts);
+        if (test_workspaces.size() < count) test_workspaces.resize(count);
+        for (size_t t = 0; t < count; ++t)
+            if (test_workspaces[t].layers.size() != net.layers.size())
+                test_workspaces[t] = net.makeWorkspace();
+        test_errors.resize(dataset_test.size());
+        std::atomic<size_t> next_part{0};
+        NNThreadPool::global().run(count, [&](size_t t) {
+            NNWorkspace& ws = test_workspaces[t];
+            size_t output_size = net.layers.back()->getSize();
+            for (size_t part; (part = next_part++) < parts;) {
+                size_t first = part * part_size;
+                gatherInputs(dataset_test, first, std::min(first + part_size, dataset_test.size()), ws.input);
+                net.evaluateBatch(ws.input, ws);
+                const NNMatrix& nn_res = ws.outputValues();
+                for (size_t sample = 0; sample < nn_res.rows(); ++sample)
+                    test_errors[first + sample] =
+                        loss.calculateError(nn_res[sample], dataset_test.outputs()[first + sample], output_size);
+            }
+        });
+        float test_error = 0.0f;
+        for (float err : test_errors) test_error += err;
+        test_error /= dataset_test.size();
+        test_error *= training_size;
+        return test_error;
+    }
+
+    // forward and backward pass for the samples shuffle_order[first .. last)
+    // with the buffers of a thread, gradient of edges is stored in (or
+    // added to) gradients, the loss of every sample in errors
+    void accumulateGradient(NNWorkspace& ws, std::vector<NNEdgeMatrix>& gradients,
+                            size_t first, size_t last, bool accumulate, float* errors) {
+        // forward pass for the whole part at once
+        gatherInputs(dataset, shuffle_order.data() + first, last - first, ws.input);
+        network->evaluateBatch(ws.input, ws);
+        lossGradient(ws, first, errors);
+
+        // backprop for all the samples at once, gradients are summed over them
+        network->gradientDescentBatch(ws, gradients, accumulate);
+    }
+
+    // gradient of the loss into ws.outputGradient() for the samples
+    // shuffle_order[first ..], just evaluated with ws, the loss of every
+    // sample in errors
+    void lossGradient(NNWorkspace& ws, size_t first, float* errors) {
+        const NNMatrix& network_out = ws.outputValues();
+        NNMatrix& loss_gradient = ws.outputGradient();
+        loss_gradient.setShape(network_out.rows(), network_out.cols());
+        size_t output_size = network->getLastLayerAfterEvaluation().getSize();
+
+        // loss of every sample
+        for (size_t sample = 0; sample < network_out.rows(); ++sample) {
+            auto dp = std::as_const(dataset)[shuffle_order[first + sample]];
+            if (debug) {
+
+                std::cerr << "DP in : ";
+                for (float f : dp.input) std::cerr << f << " ";
+                std::cerr << std::endl;
+            }
+
+            if (debug) {
+
+                std::cerr << "Network nodes:\n";
+                for (int i = 0; i < network->layers.size(); ++i) {
+                    auto && l = network->layers[i];
+                    auto && lw = ws.layers[i];
+                    std::cerr << "Layer " << i << " post act:\n";
+                    for (size_t n = 0; n < l->getFullSize(); ++n)
+                        std::cerr << std::setw(9) << std::fixed << std::setprecision(4) << lw.values[sample][n];
+                    std::cerr << "\n\n";
+                }
+
+
+                std::cerr << "DP out : ";
+                for (float f : dp.output) std::cerr << f << " ";
+                std::cerr << "\n";
+            }
+
+            const float* network_ans = network_out[sample];
+
+            if (debug) {
+                std::cerr << "NN out : ";
+                for (size_t i = 0; i < output_size; ++i) std::cerr << network_ans[i] << " ";
+                std::cerr << "\n";
+            }
+
+            if (debug) {
+                auto network_ans_cal = loss_fun->normalize(NNLayerValues(network_ans, network_ans + output_size));
+                std::cerr << "NN out norm: ";
+                for (float f : network_ans_cal) std::cerr << f << " ";
+                std::cerr << "\n";
+            }
+
+            loss_fun->calculateDerivative(network_ans, dp.output.data(), loss_gradient[sample], output_size);
+
+            if (debug) {
+                std::cerr << "Err der : ";
+                for (size_t i = 0; i < output_size; ++i) std::cerr << loss_gradient[sample][i] << " ";
+                std::cerr << "\n";
+            }
+
+            auto err = loss_fun->calculateError(network_ans, dp.output.data(), output_size);
+            errors[sample] = err;
+        }
+    }
+
+    // weights -= hogwild_learning_rate * gradient (clipped), racing with
+    // the other threads doing the same
+    void applyHogwildStep(std::vector<NNEdgeMatrix>& gradients) {
+        const NNSimdKernels& kernels = simd();
+        float gradient_norm = 0.0f;
+        for (auto& g : gradients)
+            gradient_norm += kernels.gradient_norm(g.data(), g.bufferSize(), hogwild_learning_rate);
+        NNOptimizerStep step;
+        step.learning_rate = hogwild_learning_rate;
+        if (gradient_norm > hogwild_gradient_threshold)
+            step.clip = hogwild_gradient_threshold / gradient_norm;
+        for (size_t i = 0; i < gradients.size(); ++i)
+            kernels.sgd_step(gradients[i].data(), network->connections[i].data(),
+                             gradients[i].bufferSize(), step);
+    }
+
+    static void addMatrices(const std::vector<NNEdgeMatrix>& v_in, std::vector<NNEdgeMatrix>& v_out) {
+        for (size_t matrix_id = 0; matrix_id < v_in.size(); ++matrix_id) {
+            const auto& m_in = v_in[matrix_id];
+            auto& m_out = v_out[matrix_id];
+            assert(m_in.bufferSize() == m_out.bufferSize());
+            // same shapes, so same strides, just stream both buffers
+            const float* in = m_in.data();
+            float* out = m_out.data();
+            for (size_t i = 0; i < m_in.bufferSize(); ++i) {
+                out[i] += in[i];
+            }
+        }
+    }
+
+    // copies inputs of the rows [first, last) of data into rows of a matrix,
+    // a copy per row, the set is not padded, the matrix is (and its padding
+    // stays zero)
+    static void gatherInputs(const Dataset& data, size_t first, size_t last, NNMatrix& out) {
+        if (first == last) return;
+        const DataMatrix& inputs = data.inputs();
+        out.setShape(last - first, inputs.cols());
+        for (size_t r = first; r < last; ++r)
+            std::memcpy(out[r - first], inputs[r], inputs.cols() * sizeof(float));
+    }
+    // the same for the rows rows[0 .. count)
+    static void gatherInputs(const Dataset& data, const uint32_t* rows, size_t count, NNMatrix& out) {
+        if (count == 0) return;
+        const DataMatrix& inputs = data.inputs();
+        out.setShape(count, inputs.cols());
+        for (size_t r = 0; r < count; ++r)
+            std::memcpy(out[r], inputs[rows[r]], inputs.cols() * sizeof(float));
     }
 
 public: // whatev im out of time
     std::unique_ptr<NNMomentum> momentum;
+    std::unique_ptr<NNOptimizer> optimizer;
     std::unique_ptr<NNTerminator> terminator;
-    std::unique_ptr<NNLossFun> loss_fun;
+    std::shared_ptr<NNLossFun> loss_fun; // shared with the test evaluation
     std::unique_ptr<NeuralNetwork> network;
-    std::vector<DataPoint> dataset;
-    std::vector<DataPoint> dataset_test;
+    Dataset dataset;
+    Dataset dataset_test;
     DataPoint dataset_min;
     DataPoint dataset_max;
-    std::vector<std::vector<DataPoint>> batches;
+    std::vector<Batch> batches;
+    std::vector<uint32_t> shuffle_order; // of the rows of dataset, this epoch
 
     size_t next_to_take = 0;
     size_t batch_size = 0;
+    size_t sub_batch_size = 256;        // samples propagated at once while learning
+    size_t evaluation_batch_size = 256; // samples evaluated at once on the test set
+    size_t threads = 0;                 // training threads, 0 for all of the pool
+    size_t min_samples_per_thread = 64; // smaller shards are not worth a thread
+    bool hogwild = false;               // learnEpoch does learnEpochHogwild
+    // the same results whatever the number of threads (not with hogwild)
+    bool deterministic = false;
+    size_t deterministic_chunk_size = 64; // samples with a gradient of their own
+    // groups of layers working at once on different micro-batches,
+    // for deep networks, 0 or 1 for none (threads then split the batch)
+    size_t pipeline_stages = 0;
+    size_t pipeline_micro_batch_size = 32;
+    // groups of neurons of a wide layer computed at once by different
+    // threads, for wide networks, 0 or 1 for none
+    size_t layer_shards = 0;
+    size_t min_sharded_layer_size = 1024; // narrower layers are not split
+    float hogwild_learning_rate = 0.05;
+    float hogwild_gradient_threshold = 1.0;
     bool stopped = false;
     int last_version = 0;
     std::atomic_int epoch = 0;
@@ -317,14 +788,28 @@ public: // whatev im out of time
     std::vector<float> error_history;
     std::vector<float> error_history_test;
     std::vector<float> error_history_epoch;
-    std::shared_ptr<NeuralNetwork> last_readable;
+    std::shared_ptr<NeuralNetwork> last_readable;         // published snapshots, read only
     std::shared_ptr<NeuralNetwork> last_readable_changes;
-
-    std::shared_ptr<NeuralNetwork>  GetLastReadable() {
+    std::vector<std::shared_ptr<NeuralNetwork>> spare_readable; // old ones, reused when unused
+    std::vector<std::shared_ptr<NeuralNetwork>> spare_readable_changes;
+
+    std::vector<TrainingThread> training_threads;
+    std::vector<std::vector<NNEdgeMatrix>> chunk_gradients; // of the chunks but the first
+    std::vector<NNEdgeMatrix> hogwild_start; // weights before the hogwild epoch, then its change
+    NNPipeline pipeline;
+    NNModelParallel model_parallel;
+    std::unique_ptr<NNCommunicator> communicator; // of a worker of a multi-process training
+    NNTaskGroup test_evaluation;           // of the test error in the background
+    std::vector<NNWorkspace> test_workspaces;
+    std::vector<float> test_errors;
+    size_t test_errors_evaluated = 0;      // entries of error_history_test done, under m
+
+    // evaluate them with a workspace from makeWorkspace()
+    std::shared_ptr<const NeuralNetwork>  GetLastReadable() {
         std::lock_guard l{m};
         return last_readable;
     }
-    std::shared_ptr<NeuralNetwork>  GetLastReadableChanges() {
+    std::shared_ptr<const NeuralNetwork>  GetLastReadableChanges() {
         std::lock_guard l{m};
         return last_readable_changes;
     }
@@ -332,6 +817,6 @@ public: // whatev im out of time
 
     size_t getCurrentEpoch() { return (size_t)epoch.load();}
     float getCurrentError() { std::lock_guard l {m}; return error_history.empty() ? NAN : error_history.back(); }
-    float getCurrentErrorTest() { std::lock_guard l {m}; return error_history_test.empty() ? NAN : error_history_test.back(); }
+    float getCurrentErrorTest() { std::lock_guard l {m}; return test_errors_evaluated == 0 ? NAN : error_history_test[test_errors_evaluated - 1]; }
     std::vector<float> getErrorHistory() { std::lock_guard l {m}; return error_history; }
 };
\ No newline at end of file
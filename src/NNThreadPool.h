@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class NNThreadPool;
+
+// Tasks waited for (or cancelled) together. Tasks of a cancelled group
+// that have not started are skipped, running ones may poll cancelled().
+// The first exception a task throws is rethrown by wait().
+class NNTaskGroup {
+public:
+    NNTaskGroup() = default;
+    NNTaskGroup(const NNTaskGroup&) = delete;
+    NNTaskGroup& operator=(const NNTaskGroup&) = delete;
+    ~NNTaskGroup() { assert(done()); }
+
+    void cancel() { cancel_requested = true; }
+    bool cancelled() const { return cancel_requested.load(std::memory_order_relaxed); }
+    bool done() const { return pending == 0; }
+
+    // runs other tasks of the pool while waiting
+    void wait();
+
+    // makes a finished group usable again after a cancel or an exception
+    void reset() {
+        assert(done());
+        cancel_requested = false;
+        error = nullptr;
+    }
+
+private:
+    friend class NNThreadPool;
+    void fail(std::exception_ptr e) {
+        std::lock_guard l{m};
+        if (!error) error = std::move(e);
+    }
+
+    NNThreadPool* pool = nullptr;
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> queued{0}; // of pending, the ones nobody took yet
+    std::atomic<bool> cancel_requested{false};
+    std::mutex m;
+    std::exception_ptr error;
+};
+
+// Work-stealing scheduler shared by the whole program (global()), so
+// training, evaluation and the GUI do not start threads of their own.
+// Every worker has a deque of tasks: it works on its newest task, idle
+// workers steal the oldest tasks of the others (the biggest parts of a
+// split range). Threads outside the pool put their tasks in a shared
+// deque. A thread waiting for a group runs the tasks of that group
+// meanwhile, so tasks can wait for tasks they spawned, but never the tasks
+// of another group, it would be stuck there until they are done.
+// Tasks of runPinned go to the deque of a given worker and are never
+// stolen, so the same index runs on the same thread call after call.
+// Long running jobs (submit) have a queue of their own that only idle
+// workers take from, a thread waiting for a group only runs the jobs of
+// that group (which nobody started yet).
+// The pool finishes the jobs running when it is destroyed, the queued
+// ones are cancelled (their groups are done without them).
+class NNThreadPool {
+public:
+    // workers besides the threads calling in, 0 for one per core but one
+    explicit NNThreadPool(size_t workers_wanted = 0)
+        : worker_count{workers_wanted ? workers_wanted
+                                      : std::max(std::thread::hardware_concurrency(), 2u) - 1} {
+        queues = std::make_unique<TaskQueue[]>(worker_count + 1);
+        free_workers = std::make_unique<std::atomic<bool>[]>(worker_count);
+        for (size_t i = 0; i < worker_count; ++i) free_workers[i] = true;
+        for (size_t i = 0; i < worker_count; ++i)
+            workers.emplace_back([this, i] { workerLoop(i); });
+    }
+    ~NNThreadPool() {
+        {
+            std::lock_guard l{sleep_m};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+        // nobody takes the jobs any more, their waiters are released
+        Task task;
+        while (takeJob(task)) {
+            task.group->cancel();
+            execute(task);
+        }
+    }
+    NNThreadPool(const NNThreadPool&) = delete;
+    NNThreadPool& operator=(const NNThreadPool&) = delete;
+
+    // never destroyed: objects with static storage made before it (a global
+    // NNTeacher of the GUI) still wait for their groups when they go, after
+    // a function-local static would be gone; the workers die with the process
+    static NNThreadPool& global() {
+        static NNThreadPool& pool = *new NNThreadPool;
+        return pool;
+    }
+
+    // threads that can work at once, the workers and a caller
+    size_t size() const { return worker_count + 1; }
+
+    // body(first, last) for parts of [begin, end) of about grain indices,
+    // returns when all are done
+    template <typename Body>
+    void parallelFor(size_t begin, size_t end, size_t grain, const Body& body) {
+        if (begin >= end) return;
+        grain = std::max<size_t>(grain, 1);
+        if (worker_count == 0 || end - begin <= grain) {
+            body(begin, end);
+            return;
+        }
+        NNTaskGroup group;
+        group.pool = this;
+        RangeContext<Body> context{&body, grain, &group, this};
+        try {
+            RangeContext<Body>::run(&context, begin, end);
+        } catch (...) {
+            group.cancel();
+            waitFor(group);
+            throw;
+        }
+        group.wait();
+    }
+
+    // job(i) for every i in [0, tasks)
+    template <typename Job>
+    void run(size_t tasks, const Job& job) {
+        parallelFor(0, tasks, 1, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) job(i);
+        });
+    }
+
+    // job(i) for every i in [0, tasks), task i on worker i % workers, so
+    // a task that works on the same data every call finds it in the cache
+    // of the core of that worker. Only a preference: a thread waiting for
+    // the tasks takes those of a worker busy with something else, rather
+    // than wait for it.
+    template <typename Job>
+    void runPinned(size_t tasks, const Job& job) {
+        if (worker_count == 0 || tasks <= 1) {
+            for (size_t i = 0; i < tasks; ++i) job(i);
+            return;
+        }
+        NNTaskGroup group;
+        group.pool = this;
+        for (size_t i = 0; i < tasks; ++i) {
+            Task task;
+            task.run = [](void* context, size_t index, size_t) { (*static_cast<const Job*>(context))(index); };
+            task.context = const_cast<Job*>(&job);
+            task.begin = i;
+            task.group = &group;
+            task.pinned = true;
+            spawn(task, i % worker_count);
+        }
+        group.wait();
+    }
+
+    // reduce(... reduce(map(part 0), map(part 1)) ..., map(part n)), the parts
+    // are [begin, end) cut every grain indices and they are always combined
+    // in this order, so the result does not depend on the scheduling
+    template <typename T, typename Map, typename Reduce>
+    T parallelReduce(size_t begin, size_t end, size_t grain, T identity,
+                     const Map& map, const Reduce& reduce) {
+        if (begin >= end) return identity;
+        grain = std::max<size_t>(grain, 1);
+        size_t parts = (end - begin + grain - 1) / grain;
+        std::vector<T> partial(parts, identity);
+        run(parts, [&](size_t part) {
+            size_t first = begin + part * grain;
+            partial[part] = map(first, std::min(first + grain, end));
+        });
+        T result = std::move(identity);
+        for (auto& p : partial) result = reduce(std::move(result), std::move(p));
+        return result;
+    }
+
+    // starts a long running job (a copy of job, called as job()), wait for
+    // it or cancel it through the group
+    template <typename Job>
+    void submit(NNTaskGroup& group, Job job) {
+        Task task;
+        task.context = new Job(std::move(job));
+        task.run = [](void* context, size_t, size_t) { (*static_cast<Job*>(context))(); };
+        task.destroy = [](void* context) { delete static_cast<Job*>(context); };
+        task.group = &group;
+        group.pool = this;
+        ++group.pending;
+        ++group.queued;
+        {
+            std::lock_guard l{sleep_m};
+            jobs.push_back(task);
+            ++queued_jobs;
+        }
+        wake.notify_all();
+    }
+
+private:
+    friend class NNTaskGroup;
+
+    struct Task {
+        void (*run)(void* context, size_t begin, size_t end) = nullptr;
+        void (*destroy)(void* context) = nullptr; // for owned contexts
+        void* context = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+        NNTaskGroup* group = nullptr;
+        bool pinned = false; // to the worker of its queue, see runPinned
+    };
+
+    // fixed size ring of tasks, the owner takes from the back,
+    // thieves from the front (the oldest task that is not pinned)
+    struct TaskQueue {
+        static constexpr size_t capacity = 256;
+        std::mutex m;
+        Task tasks[capacity];
+        size_t head = 0;
+        size_t count = 0;
+
+        bool pushBack(const Task& t) {
+            std::lock_guard l{m};
+            if (count == capacity) return false;
+            tasks[(head + count++) % capacity] = t;
+            return true;
+        }
+        bool popBack(Task& t) {
+            std::lock_guard l{m};
+            if (count == 0) return false;
+            t = tasks[(head + --count) % capacity];
+            return true;
+        }
+        bool popFront(Task& t) {
+            std::lock_guard l{m};
+            if (count == 0) return false;
+            if (tasks[head].pinned) return takeAt(nullptr, false, false, t);
+            t = tasks[head];
+            head = (head + 1) % capacity;
+            --count;
+            return true;
+        }
+        // the newest (or the oldest) task of the group, the ones
+        // after it move down a place
+        bool takeOf(const NNTaskGroup* group, bool newest, bool pinned_too, Task& t) {
+            std::lock_guard l{m};
+            return takeAt(group, newest, pinned_too, t);
+        }
+        // the same for any group (nullptr), under m
+        bool takeAt(const NNTaskGroup* group, bool newest, bool pinned_too, Task& t) {
+            for (size_t n = 0; n < count; ++n) {
+                size_t i = newest ? count - 1 - n : n;
+                const Task& candidate = tasks[(head + i) % capacity];
+                if ((group && candidate.group != group) || (candidate.pinned && !pinned_too)) continue;
+                t = tasks[(head + i) % capacity];
+                for (--count; i < count; ++i)
+                    tasks[(head + i) % capacity] = tasks[(head + i + 1) % capacity];
+                return true;
+            }
+            return false;
+        }
+    };
+
+    // a range task of parallelFor, splits off halves for the thieves
+    // until it is down to the grain
+    template <typename Body>
+    struct RangeContext {
+        const Body* body;
+        size_t grain;
+        NNTaskGroup* group;
+        NNThreadPool* pool;
+
+        static void run(void* c, size_t begin, size_t end) {
+            auto context = static_cast<RangeContext*>(c);
+            while (end - begin > context->grain) {
+                size_t middle = begin + (end - begin) / 2;
+                Task task;
+                task.run = &RangeContext::run;
+                task.context = context;
+                task.begin = middle;
+                task.end = end;
+                task.group = context->group;
+                context->pool->spawn(task);
+                end = middle;
+            }
+            (*context->body)(begin, end);
+        }
+    };
+
+    void spawn(Task task) { spawn(task, current_pool == this ? current_worker : worker_count); }
+    void spawn(Task task, size_t queue) {
+        ++task.group->pending;
+        // before it can be taken, so these never go below zero
+        ++queued_tasks;
+        ++task.group->queued;
+        if (!queues[queue].pushBack(task)) {
+            --queued_tasks;
+            --task.group->queued;
+            execute(task); // full, no point in queuing more
+            return;
+        }
+        if (sleeping > 0) {
+            // all of them, the one waiting for this group may be any
+            { std::lock_guard l{sleep_m}; }
+            wake.notify_all();
+        }
+    }
+
+    // a task for the given queue (its own one) to run, not a job
+    bool takeTask(size_t own, Task& task) {
+        if (queued_tasks == 0) return false;
+        size_t count = worker_count + 1;
+        bool found = own < worker_count && queues[own].popBack(task);
+        for (size_t i = 0; !found && i < count; ++i) {
+            size_t victim = (own + 1 + i) % count;
+            if (victim != own || own == worker_count) found = queues[victim].popFront(task);
+        }
+        if (found) {
+            --queued_tasks;
+            --task.group->queued;
+        }
+        return found;
+    }
+
+    // a task of the group, the newest one of the given queue (its own one)
+    // or the oldest one of another, pinned ones only of a busy worker
+    bool takeTaskOf(size_t own, const NNTaskGroup& group, Task& task) {
+        if (group.queued == 0) return false;
+        size_t count = worker_count + 1;
+        bool found = false;
+        for (size_t i = 0; !found && i < count; ++i) {
+            size_t queue = (own + i) % count;
+            bool pinned_too = queue == own || (queue < worker_count && !free_workers[queue]);
+            found = queues[queue].takeOf(&group, queue == own, pinned_too, task);
+        }
+        if (found) {
+            --queued_tasks;
+            --task.group->queued;
+        }
+        return found;
+    }
+
+    // a job of the group that is still queued
+    bool takeJobOf(const NNTaskGroup& group, Task& task) {
+        if (queued_jobs == 0) return false;
+        std::lock_guard l{sleep_m};
+        auto job = std::find_if(jobs.begin(), jobs.end(), [&](const Task& t) { return t.group == &group; });
+        if (job == jobs.end()) return false;
+        task = *job;
+        jobs.erase(job);
+        --queued_jobs;
+        --task.group->queued;
+        return true;
+    }
+
+    bool takeJob(Task& task) {
+        if (queued_jobs == 0) return false;
+        std::lock_guard l{sleep_m};
+        if (jobs.empty()) return false;
+        task = jobs.front();
+        jobs.pop_front();
+        --queued_jobs;
+        --task.group->queued;
+        return true;
+    }
+
+    void execute(Task& task) {
+        NNTaskGroup* group = task.group;
+        if (!group->cancelled()) {
+            try {
+                task.run(task.context, task.begin, task.end);
+            } catch (...) {
+                group->fail(std::current_exception());
+            }
+        }
+        if (task.destroy) task.destroy(task.context);
+        // the group may be gone right after this
+        if (--group->pending == 0) {
+            { std::lock_guard l{sleep_m}; }
+            wake.notify_all();
+        }
+    }
+
+    void workerLoop(size_t index) {
+        current_pool = this;
+        current_worker = index;
+        Task task;
+        while (true) {
+            // a stopping pool starts no more jobs, the destructor cancels them
+            if (takeTask(index, task) || (!stopping && takeJob(task))) {
+                free_workers[index] = false;
+                execute(task);
+                free_workers[index] = true;
+                continue;
+            }
+            ++sleeping;
+            {
+                std::unique_lock l{sleep_m};
+                wake.wait(l, [this] { return stopping || queued_tasks > 0 || queued_jobs > 0; });
+            }
+            --sleeping;
+            if (stopping) return;
+        }
+    }
+
+    // the tasks and the jobs of the group that nobody took yet are run
+    // while the group is not done
+    void waitFor(NNTaskGroup& group) {
+        size_t own = current_pool == this ? current_worker : worker_count;
+        Task task;
+        while (!group.done()) {
+            if (takeTaskOf(own, group, task) || takeJobOf(group, task)) {
+                execute(task);
+                continue;
+            }
+            ++sleeping;
+            {
+                std::unique_lock l{sleep_m};
+                wake.wait(l, [&] { return group.done() || group.queued > 0; });
+            }
+            --sleeping;
+        }
+    }
+
+    const size_t worker_count; // the threads see it before workers is complete
+    std::vector<std::thread> workers;
+    std::unique_ptr<TaskQueue[]> queues; // one per worker and a shared one, last
+    std::unique_ptr<std::atomic<bool>[]> free_workers; // not running anything, they take their pinned tasks
+    std::deque<Task> jobs;               // under sleep_m
+    std::atomic<size_t> queued_tasks{0};
+    std::atomic<size_t> queued_jobs{0};
+    std::atomic<size_t> sleeping{0};
+    std::mutex sleep_m;
+    std::condition_variable wake;
+    std::atomic<bool> stopping{false}; // set under sleep_m, not to miss a wake
+
+    inline static thread_local NNThreadPool* current_pool = nullptr;
+    inline static thread_local size_t current_worker = 0;
+};
+
+inline void NNTaskGroup::wait() {
+    if (pool) pool->waitFor(*this);
+    assert(done());
+    std::lock_guard l{m};
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "NNAliases.h"
+#include "NNMatrix.h"
+
+// intermediate buffers of a single layer
+struct NNLayerWorkspace {
+    // batches, one sample per row
+    NNMatrix values;   // with activation function (and the bias column),
+                       // the weighted inputs are only there during the gemm
+    NNMatrix gradient; // dCost/dA, same shape as values
+    NNMatrix delta;    // dCost/dZ
+
+    // the same for a single sample
+    NNLayerValues sample_values;
+    NNLayerValues sample_gradient;
+    NNLayerValues sample_delta;
+};
+
+// Every buffer forward and backward propagation needs, kept between calls.
+// Shapes only change when the batch size does, so once the buffers are
+// grown to the largest batch a training step does no heap allocation.
+// This is all the mutable state of an evaluation, the network itself is
+// only read, so every thread evaluating a network needs its own one
+// (NeuralNetwork::makeWorkspace).
+class NNWorkspace {
+public:
+    void addLayer(size_t size, size_t full_size) {
+        layers.emplace_back();
+        layers.back().sample_values.resize(full_size);
+        if (full_size > size) layers.back().sample_values.back() = 1; // bias
+        layers.back().sample_gradient.resize(full_size);
+        layers.back().sample_delta.resize(size);
+        sizes.push_back(size);
+        full_sizes.push_back(full_size);
+        if (batch_capacity > 0) reserve(batch_capacity);
+    }
+
+    // grows all the batch buffers for batches of up to batch_size samples
+    void reserve(size_t batch_size) {
+        batch_capacity = batch_size;
+        input.setShape(batch_size, sizes.empty() ? 0 : sizes[0]);
+        for (size_t l = 0; l < layers.size(); ++l) {
+            layers[l].values.setShape(batch_size, full_sizes[l]);
+            layers[l].gradient.setShape(batch_size, full_sizes[l]);
+            layers[l].delta.setShape(batch_size, sizes[l]);
+        }
+    }
+
+    NNMatrix& outputValues() { return layers.back().values; }
+    NNMatrix& outputGradient() { return layers.back().gradient; }
+
+    NNMatrix input; // [sample][input neuron], inputs of the current batch
+    std::vector<NNLayerWorkspace> layers;
+
+private:
+    std::vector<size_t> sizes;
+    std::vector<size_t> full_sizes;
+    size_t batch_capacity = 0;
+};
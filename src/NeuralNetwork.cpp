@@ -3,34 +3,90 @@
 #include <cassert>
 #include <numeric>
 
+#include "NNThreadPool.h"
 #include "utils.h"
 
 void NeuralNetwork::initializeWithRandomData() {
-    std::uniform_real_distribution<float> dis{-1.0, 1.0};
-    for (auto& matrix : connections)
-    for (auto& neuron_out : matrix)
-    for (auto& neuron_in : neuron_out)
-        neuron_in = dis(RNG);
+    // every matrix has a stream of its own and every weight a fixed place
+    // in it, so the rows can be filled in parallel, the same for any
+    // number of threads
+    for (size_t m = 0; m < connections.size(); ++m) {
+        NNEdgeMatrix& matrix = connections[m];
+        size_t grain = std::max<size_t>(4096 / std::max<size_t>(matrix.cols(), 1), 1);
+        NNThreadPool::global().parallelFor(0, matrix.rows(), grain, [&](size_t first, size_t last) {
+            NNRandom random = RNG.stream(NNRandomStream::weights, static_cast<uint32_t>(m));
+            random.seek(first * matrix.cols());
+            for (size_t neuron_out = first; neuron_out < last; ++neuron_out)
+            for (size_t neuron_in = 0; neuron_in < matrix.cols(); ++neuron_in)
+                matrix[neuron_out][neuron_in] = random.uniform(-1.0f, 1.0f);
+        });
+    }
 }
 
-void NeuralNetwork::evaluateNetwork(const std::vector<float>& input) {
+const NNLayerValues& NeuralNetwork::evaluateNetwork(const std::vector<float>& input, NNWorkspace& ws) const {
     assert(input.size() == layers[0]->getSize());
-    layers[0]->assignValues(input);
+    assert(ws.layers.size() == layers.size());
+    layers[0]->assignValues(input, ws.layers[0]);
     for(size_t l = 1; l < layers.size(); ++l)
-        layers[l]->calculateValues(layers[l-1]->values, connections[l-1]);
+        layers[l]->calculateValues(ws.layers[l-1].sample_values, connections[l-1], ws.layers[l]);
+    return ws.layers.back().sample_values;
+}
+
+void NeuralNetwork::evaluateBatch(const NNMatrix& input, NNWorkspace& ws) const {
+    assert(input.cols() == layers[0]->getSize());
+    assert(ws.layers.size() == layers.size());
+    layers[0]->assignBatchValues(input, ws.layers[0]);
+    evaluateLayers(ws, 1, layers.size());
 }
 
-std::vector<NNEdgeMatrix> NeuralNetwork::gradientDescent(const NNLayerValues& last_layer_gradient) {
-    std::vector<NNEdgeMatrix> edges_gradients;
-    auto last_gradient = last_layer_gradient;
+void NeuralNetwork::evaluateLayers(NNWorkspace& ws, size_t first, size_t last) const {
+    assert(ws.layers.size() == layers.size() && last <= layers.size());
+    if (first == 0 && first < last) {
+        layers[0]->assignBatchValues(ws.input, ws.layers[0]);
+        first = 1;
+    }
+    for(size_t l = first; l < last; ++l)
+        layers[l]->calculateBatchValues(ws.layers[l-1].values, connections[l-1],
+                                        ws.layers[l]);
+}
+
+std::vector<NNEdgeMatrix>& NeuralNetwork::gradientDescent(const NNLayerValues& last_layer_gradient) {
+    workspace.layers.back().sample_gradient = last_layer_gradient;
     for (size_t l = this->layers.size() - 1; l > 0; l--) {
-        auto r = layers[l]->backwardPropagation(last_gradient, layers[l - 1]->values, connections[l - 1]);
-        last_gradient = std::move(r.second);
-        edges_gradients.insert(edges_gradients.begin(), std::move(r.first));
+        layers[l]->backwardPropagation(workspace.layers[l - 1].sample_values, connections[l - 1], workspace.layers[l],
+                                       gradients[l - 1], workspace.layers[l - 1].sample_gradient);
+    }
+    return gradients;
+}
+
+std::vector<NNEdgeMatrix>& NeuralNetwork::gradientDescentBatch(NNWorkspace& ws,
+                                                               std::vector<NNEdgeMatrix>& gradients_out,
+                                                               bool accumulate) const {
+    gradientDescentLayers(ws, gradients_out, 1, layers.size(), accumulate);
+    return gradients_out;
+}
+
+void NeuralNetwork::gradientDescentLayers(NNWorkspace& ws, std::vector<NNEdgeMatrix>& gradients_out,
+                                          size_t first, size_t last, bool accumulate) const {
+    assert(gradients_out.size() == connections.size() && last <= layers.size());
+    for (size_t l = last; l-- > std::max<size_t>(first, 1);) {
+        layers[l]->backwardPropagationBatch(ws.layers[l - 1].values, connections[l - 1],
+                                            ws.layers[l], gradients_out[l - 1],
+                                            ws.layers[l - 1].gradient, accumulate);
     }
-    return edges_gradients;
 }
 
+NNWorkspace NeuralNetwork::makeWorkspace() const {
+    NNWorkspace ws;
+    for (auto& l : layers) ws.addLayer(l->getSize(), l->getFullSize());
+    return ws;
+}
+
+void NeuralNetwork::assignParameters(const std::vector<std::shared_ptr<NNLayer>>& new_layers,
+                                     const std::vector<NNEdgeMatrix>& new_connections) {
+    layers = new_layers;
+    connections = new_connections;
+}
 
 NNLayer& NeuralNetwork::getNthLayerAfterEvaluation(size_t n) {
     return *layers[n];
@@ -45,11 +101,11 @@ NNEdgeMatrix& NeuralNetwork::getNthLayerEdges(size_t n) {
 
 void NeuralNetwork::addLayer(std::shared_ptr<NNLayer> l) {
     layers.push_back(std::move(l));
+    workspace.addLayer(layers.back()->getSize(), layers.back()->getFullSize());
     if (layers.size() > 1) {
         // new connection matric
-        NNEdgeMatrix em;
-        em.resize(layers.back()->getSize());
-        for (auto& v : em) v.resize(layers[layers.size() - 2]->getFullSize());
-        connections.push_back(em);
+        connections.emplace_back(layers.back()->getSize(),
+                                 layers[layers.size() - 2]->getFullSize());
+        gradients.emplace_back(connections.back().rows(), connections.back().cols());
     }
 }
\ No newline at end of file
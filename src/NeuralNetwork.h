@@ -8,21 +8,66 @@
 
 #include "NNAliases.h"
 #include "NNLayer.h"
+#include "NNWorkspace.h"
 
+// The parameters (layers and connections) and, for the one training it,
+// the buffers of the propagation. Evaluating with a workspace of the
+// caller only reads the network, so any number of threads can share one.
 class NeuralNetwork {
 public:
     void addLayer(std::shared_ptr<NNLayer>);
     void initializeWithRandomData();
-    void evaluateNetwork(const NNLayerValues& input);
+    // returns values of the last layer, stored in the workspace
+    const NNLayerValues& evaluateNetwork(const NNLayerValues& input) { return evaluateNetwork(input, workspace); }
+    const NNLayerValues& evaluateNetwork(const NNLayerValues& input, NNWorkspace& ws) const;
+    // evaluates a whole batch at once, input is [sample][input neuron],
+    // results end up in the workspace, the output in workspace.outputValues()
+    void evaluateBatch(const NNMatrix& input) { evaluateBatch(input, workspace); }
+    // the same with buffers of the caller, leaves the network untouched,
+    // so threads with their own workspaces can evaluate at the same time
+    void evaluateBatch(const NNMatrix& input, NNWorkspace& ws) const;
 
     // before calling that, reassign all neurons!!!
-    // returns gradient of edges
-    std::vector<NNEdgeMatrix> gradientDescent(const NNLayerValues& last_layer_gradient);
+    // returns gradient of edges, stored in gradients
+    std::vector<NNEdgeMatrix>& gradientDescent(const NNLayerValues& last_layer_gradient);
+    // same for the batch evaluated last, gradient of the last layer
+    // ([sample][neuron]) has to be in workspace.outputGradient(),
+    // returns gradient of edges summed over the batch, stored in gradients,
+    // with accumulate the gradient is added to what gradients already hold
+    // (so a big batch can be done in smaller parts)
+    std::vector<NNEdgeMatrix>& gradientDescentBatch(bool accumulate = false) {
+        return gradientDescentBatch(workspace, gradients, accumulate);
+    }
+    // the same for a batch evaluated with ws, into gradients_out
+    std::vector<NNEdgeMatrix>& gradientDescentBatch(NNWorkspace& ws,
+                                                    std::vector<NNEdgeMatrix>& gradients_out,
+                                                    bool accumulate = false) const;
+
+    // the same for the layers [first, last) only, for running groups of
+    // layers separately (NNPipeline): evaluateLayers takes the values of
+    // layer first - 1 from ws (layer 0 takes ws.input), gradientDescentLayers
+    // the gradient of layer last - 1 and gives the gradient of layer first - 1
+    // and those of the connections into these layers
+    void evaluateLayers(NNWorkspace& ws, size_t first, size_t last) const;
+    void gradientDescentLayers(NNWorkspace& ws, std::vector<NNEdgeMatrix>& gradients_out,
+                               size_t first, size_t last, bool accumulate = false) const;
+
+    // buffers for evaluating this network on another thread,
+    // the batch ones grow on first use
+    NNWorkspace makeWorkspace() const;
+
+    // becomes a network with these layers (shared, they are never written
+    // to) and connections, reusing the buffers of the connections it has,
+    // the propagation buffers of the network are not touched
+    void assignParameters(const std::vector<std::shared_ptr<NNLayer>>& new_layers,
+                          const std::vector<NNEdgeMatrix>& new_connections);
 
     NNLayer& getNthLayerAfterEvaluation(size_t n);
     NNLayer& getLastLayerAfterEvaluation();
     NNEdgeMatrix& getNthLayerEdges(size_t n);
 
     std::vector<NNEdgeMatrix> connections;
+    std::vector<NNEdgeMatrix> gradients; // same shapes as connections
     std::vector<std::shared_ptr<NNLayer>> layers;
+    NNWorkspace workspace; // buffers of the propagation, reused between calls
 };
\ No newline at end of file
@@ -7,17 +7,18 @@
 #include <stdio.h>
 #include <GLFW/glfw3.h> // Will drag system OpenGL headers
 
-#include <future>
+#include <cmath>
 #include <memory>
 #include <map>
 
+#include "DataSetFile.h"
 #include "NNTeacher.h"
 
 std::unique_ptr<NNTeacher> teacher = std::make_unique<NNTeacher>();
 std::vector<std::string> set_labels;
-std::vector<DataPoint> training_set;
-std::vector<DataPoint> testing_set;
-std::future<void> global_waiter;
+Dataset training_set;
+Dataset testing_set;
+NNTaskGroup training_jobs; // learning on the thread pool, cancelled by "Pause learning"
 
 int correctly_classified_training = 0;
 int correctly_classified_testing = 0;
@@ -37,7 +38,17 @@ void loadDataSetsList(std::filesystem::path path, std::vector<DatasetId>& out_li
     std::map<std::string, DatasetId> dataset_map;
     for(auto const& dir_entry : di) {
         if (!std::filesystem::is_regular_file(dir_entry)) continue;
-        if (dir_entry.path().extension() != ".csv") continue;
+        // the binary file of a CSV is used instead of it, unless the CSV is newer
+        const auto extension = dir_entry.path().extension();
+        if (extension == ".csv") {
+            if (hasUpToDateBinary(dir_entry.path().string())) continue;
+        } else if (extension == data_set_file_extension) {
+            auto csv_path = dir_entry.path();
+            csv_path.replace_extension(".csv");
+            if (std::filesystem::exists(csv_path) && !hasUpToDateBinary(csv_path.string())) continue;
+        } else {
+            continue;
+        }
 
         const auto name = dir_entry.path().stem();
 
@@ -119,11 +130,9 @@ bool show_nn_error_plot = false;
 
 bool show_network_configuration = false;
 bool network_initialized = false;
-bool learning_on_side_thread = false;
 
 int class_count = -1;
 
-std::atomic<bool> stop_requested = false;
 
 void initializeTeacher() {
     teacher = std::make_unique<NNTeacher>();
@@ -132,7 +141,43 @@ void initializeTeacher() {
     teacher->addTestingDataset(testing_set);
 }
 
-void showDataWindowText(std::string name, const std::vector<DataPoint>& data_set) {
+bool learningOnSideThread() {
+    return !training_jobs.done();
+}
+
+// waits for the learning on the thread pool to end, a failure is reported
+// (reset() would forget it)
+void waitForLearning() {
+    try {
+        training_jobs.wait();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "learning failed: %s\n", e.what());
+    } catch (const char* e) {
+        fprintf(stderr, "learning failed: %s\n", e);
+    } catch (...) {
+        fprintf(stderr, "learning failed\n");
+    }
+}
+
+// learns up to epochs epochs (until finished when negative) on the thread pool
+void startLearning(int epochs) {
+    waitForLearning();
+    training_jobs.reset();
+    NNTeacher* t = teacher.get();
+    NNThreadPool::global().submit(training_jobs, [t, epochs]() {
+        for (int i = 0; epochs < 0 || i < epochs; ++i) {
+            if (t->finished() || training_jobs.cancelled()) break;
+            t->learnEpoch();
+        }
+    });
+}
+
+void stopLearning() {
+    training_jobs.cancel();
+    waitForLearning();
+}
+
+void showDataWindowText(std::string name, const Dataset& data_set) {
     ImGui::Begin(("Input data - " + name).c_str());
     static ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV | ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable;
 
@@ -157,10 +202,10 @@ void showDataWindowText(std::string name, const std::vector<DataPoint>& data_set
                 for (int column = 0; column < set_labels.size(); column++)
                 {
                     ImGui::TableSetColumnIndex(column);
-                    if (column < data_set[row].input.size())
+                    if (column < data_set.inputSize())
                         ImGui::Text("%f", data_set[row].input[column]);
                     else
-                        ImGui::Text("%f", data_set[row].output[column - data_set[row].input.size()]);
+                        ImGui::Text("%f", data_set[row].output[column - data_set.inputSize()]);
                 }
             }
         }
@@ -191,39 +236,37 @@ void drawVisualRegression() {
         if (show_test_data_visual) {
             std::vector<float> xs;
             std::vector<float> ys;
-            for (auto&& el : testing_set) {
-                xs.push_back(el.input[0]);
-                ys.push_back(el.output[0]);
+            for (size_t i = 0; i < testing_set.size(); ++i) {
+                xs.push_back(testing_set[i].input[0]);
+                ys.push_back(testing_set[i].output[0]);
             }
             drawInputSampleRegressionData("Testing Test Cases", true, xs, ys);
         }
         if (show_train_data_visual) {
             std::vector<float> xs;
             std::vector<float> ys;
-            for (auto&& el : training_set) {
-                xs.push_back(el.input[0]);
-                ys.push_back(el.output[0]);
+            for (size_t i = 0; i < training_set.size(); ++i) {
+                xs.push_back(training_set[i].input[0]);
+                ys.push_back(training_set[i].output[0]);
             }
             drawInputSampleRegressionData("Training Test cases", true, xs, ys);
         }
 
         if (show_nn_result_visual) {
             auto nn = teacher->GetLastReadable();
-
-            std::lock_guard l(teacher->m); // i cry
+            NNWorkspace ws = nn->makeWorkspace();
 
             if (testing_set.size() > 0) {
                 std::vector<float> xs;
                 std::vector<float> ys;
-                for (auto&& el : testing_set) {
-                    float x = el.input[0];
+                for (size_t i = 0; i < testing_set.size(); ++i) {
+                    float x = testing_set[i].input[0];
                     xs.push_back(x);
 
                     DataPoint dp;
                     dp.input.push_back(x);
                     teacher->normalizeDatapoint(dp);
-                    nn->evaluateNetwork(dp.input);
-                    dp.output = nn->layers.back()->values;
+                    dp.output = nn->evaluateNetwork(dp.input, ws);
                     teacher->denormalizeDatapoint(dp);
                     ys.push_back(dp.output[0]);
                 }
@@ -233,15 +276,14 @@ void drawVisualRegression() {
             {
                 std::vector<float> xs;
                 std::vector<float> ys;
-                for (auto&& el : training_set) {
-                    float x = el.input[0];
+                for (size_t i = 0; i < training_set.size(); ++i) {
+                    float x = training_set[i].input[0];
                     xs.push_back(x);
 
                     DataPoint dp;
                     dp.input.push_back(x);
                     teacher->normalizeDatapoint(dp);
-                    nn->evaluateNetwork(dp.input);
-                    dp.output = nn->layers.back()->values;
+                    dp.output = nn->evaluateNetwork(dp.input, ws);
                     teacher->denormalizeDatapoint(dp);
                     ys.push_back(dp.output[0]);
                 }
@@ -256,15 +298,18 @@ void drawVisualRegression() {
 }
 
 void drawVisualClassificationData(std::string title,
-            const std::vector<DataPoint>& data_set) {
+            const Dataset& data_set) {
     ImGui::Begin(("Classification visualization - " + title).c_str());
 
-    std::vector<std::vector<DataPoint>> classes(class_count);
+    // coordinates of the points of every class
+    std::vector<std::vector<float>> class_xs(class_count);
+    std::vector<std::vector<float>> class_ys(class_count);
 
     for (size_t i = 0; i < data_set.size(); ++i) {
         for (size_t j = 0; j < class_count; ++j)
             if (data_set[i].output[j] == 1) {
-                classes[j].push_back(data_set[i]);
+                class_xs[j].push_back(data_set[i].input[0]);
+                class_ys[j].push_back(data_set[i].input[1]);
                 break;
             }
     }
@@ -274,13 +319,8 @@ void drawVisualClassificationData(std::string title,
         ImPlot::SetupAxes("x","y", flags, flags);
 
         for (int c = 0; c < class_count; ++c) {
-            auto&& cc = classes[c];
-            std::vector<float> xs;
-            std::vector<float> ys;
-            for (auto&& el : cc) {
-                xs.push_back(el.input[0]);
-                ys.push_back(el.input[1]);
-            }
+            auto&& xs = class_xs[c];
+            auto&& ys = class_ys[c];
             ImPlot::PlotScatter(std::to_string(c).c_str(), xs.data(), ys.data(), xs.size());
         }
 
@@ -298,81 +338,70 @@ void drawVisualClassificationTesting() {
     drawVisualClassificationData("Testing", testing_set);
 }
 
+// replaces outputs of the points with the (one-hot) answers of the last
+// network, parts of the set are done in parallel on the thread pool,
+// returns how many points were classified correctly
+int classifyWithLastNetwork(Dataset& points) {
+    auto nn = teacher->GetLastReadable();
+    return NNThreadPool::global().parallelReduce(0, points.size(), 256, 0,
+        [&](size_t begin, size_t end) {
+            NNWorkspace ws = nn->makeWorkspace();
+            int correct = 0;
+            for (size_t i = begin; i < end; ++i) {
+                auto row = points[i];
+                DataPoint dp{{row.input.begin(), row.input.end()},
+                             {row.output.begin(), row.output.end()}};
+                auto ans_it = std::max_element(dp.output.begin(), dp.output.end());
+                int ans_id = ans_it - dp.output.begin();
+
+                teacher->normalizeDatapoint(dp);
+                dp.output = nn->evaluateNetwork(dp.input, ws);
+                teacher->denormalizeDatapoint(dp);
+
+                dp.output = teacher->loss_fun->normalize(dp.output);
+                auto max_it = std::max_element(dp.output.begin(), dp.output.end());
+                auto max_id = max_it - dp.output.begin();
+                std::fill(row.output.begin(), row.output.end(), 0.0f);
+                row.output[max_id] = 1.0;
+
+                if (ans_id == max_id) ++correct;
+            }
+            return correct;
+        },
+        [](int a, int b) { return a + b; });
+}
+
 void drawVisualClassificationTrainingNN() {
-    static std::vector<DataPoint> training_set_NN;
+    static Dataset training_set_NN;
     static int last_cached = -1;
 
     if (teacher->lastVersion() != last_cached) {
         training_set_NN = training_set;
-        auto nn = teacher->GetLastReadable();
-        std::lock_guard l(teacher->m); // i cry
         last_cached = teacher->lastVersion();
-        correctly_classified_training = 0;
-
-        for (auto& dp : training_set_NN) {
-            auto ans_it = std::max_element(dp.output.begin(), dp.output.end());
-            int ans_id = ans_it - dp.output.begin();
-
-            teacher->normalizeDatapoint(dp);
-            nn->evaluateNetwork(dp.input);
-            dp.output = nn->getLastLayerAfterEvaluation().values;
-            teacher->denormalizeDatapoint(dp);
-
-            dp.output = teacher->loss_fun->normalize(dp.output);
-            auto max_it = std::max_element(dp.output.begin(), dp.output.end());
-            auto max_id = max_it - dp.output.begin();
-            auto output_size = dp.output.size();
-            dp.output.clear();
-            dp.output.resize(output_size);
-            dp.output[max_id] = 1.0;
-
-            if (ans_id == max_id) ++correctly_classified_training;
-        }
+        correctly_classified_training = classifyWithLastNetwork(training_set_NN);
     }
 
 
-    if (training_set_NN[0].input.size() == 2)
+    if (training_set_NN.inputSize() == 2)
     drawVisualClassificationData("Training NN", training_set_NN);
 }
 
 void drawVisualClassificationTestingNN() {
-    static std::vector<DataPoint> testing_set_NN;
+    static Dataset testing_set_NN;
     static int last_cached = -1;
 
     if (teacher->lastVersion() != last_cached) {
         testing_set_NN = testing_set;
-        auto nn = teacher->GetLastReadable();
-        std::lock_guard l(teacher->m); // i cry
         last_cached = teacher->lastVersion();
-        correctly_classified_testing = 0;
-
-        for (auto& dp : testing_set_NN) {
-            auto ans_it = std::max_element(dp.output.begin(), dp.output.end());
-            int ans_id = ans_it - dp.output.begin();
-
-            teacher->normalizeDatapoint(dp);
-            nn->evaluateNetwork(dp.input);
-            dp.output = nn->getLastLayerAfterEvaluation().values;
-            teacher->denormalizeDatapoint(dp);
-
-
-            dp.output = teacher->loss_fun->normalize(dp.output);
-            auto max_it = std::max_element(dp.output.begin(), dp.output.end());
-            auto max_id = max_it - dp.output.begin();
-            auto output_size = dp.output.size();
-            dp.output.clear();
-            dp.output.resize(output_size);
-            dp.output[max_id] = 1.0;
-            if (ans_id == max_id) ++correctly_classified_testing;
-        }
+        correctly_classified_testing = classifyWithLastNetwork(testing_set_NN);
     }
 
-    if (testing_set_NN[0].input.size() == 2)
+    if (testing_set_NN.inputSize() == 2)
     drawVisualClassificationData("Testing NN", testing_set_NN);
 }
 
 
-void drawNN(std::shared_ptr<NeuralNetwork> nn) {
+void drawNN(std::shared_ptr<const NeuralNetwork> nn) {
     // Demonstrate using the low-level ImDrawList to draw custom shapes.
     if (nn == nullptr)
     {
@@ -494,7 +523,7 @@ void drawNN(std::shared_ptr<NeuralNetwork> nn) {
 
 void showNNValues() {
     auto last = teacher->GetLastReadable();
-    // now we hold a thing that won't be mutated, we can release the lock
+    // published snapshots are never mutated, no lock needed
 
     ImGui::Begin("Neural Network connections values");
     drawNN(std::move(last));
@@ -502,8 +531,8 @@ void showNNValues() {
 }
 
 void showNNChanges() {
-    std::shared_ptr<NeuralNetwork> last_changes = teacher->GetLastReadableChanges();
-    // now we hold a thing that won't be mutated, we can release the lock
+    std::shared_ptr<const NeuralNetwork> last_changes = teacher->GetLastReadableChanges();
+    // published snapshots are never mutated, no lock needed
 
     ImGui::Begin("Neural Network last batch changes");
     drawNN(std::move(last_changes));
@@ -524,8 +553,9 @@ void showNNErrorPlot() {
         }
 
         ImPlot::PlotLine("NN Error Plot on train data", xs.data(), teacher->error_history.data(), xs.size());
-        if (teacher->error_history_test.size() == teacher->error_history.size())
-        ImPlot::PlotLine("NN Error Plot on test data", xs.data(), teacher->error_history_test.data(), xs.size());
+        // the last one may still be being evaluated
+        ImPlot::PlotLine("NN Error Plot on test data", xs.data(), teacher->error_history_test.data(),
+                         std::min(teacher->test_errors_evaluated, xs.size()));
 
         ImPlot::EndPlot();
     }
@@ -563,9 +593,7 @@ void showIntroWindow() {
     ImGui::End();
 }
 
-std::vector<DataPoint> loadDataSet(std::string path) {
-    std::string data_text = slurpFile(path);
-    auto csv = parseCSV(data_text);
+Dataset makeDataset(CSVData csv) {
     bool new_labels = false;
     if (set_labels.empty()) {
         set_labels = csv.headers;
@@ -575,17 +603,20 @@ std::vector<DataPoint> loadDataSet(std::string path) {
         // look through outputs, change to one-hot-encoding
         int max_class_id = -1;
         int min_class_id = 1;
-        for (const auto& p : csv.points) {
-            max_class_id = std::max((int)p.output.back(), max_class_id);
-            min_class_id = std::min((int)p.output.back(), min_class_id);
+        const Dataset& points = csv.points;
+        for (size_t i = 0; i < points.size(); ++i) {
+            max_class_id = std::max((int)points[i].output.back(), max_class_id);
+            min_class_id = std::min((int)points[i].output.back(), min_class_id);
         }
         class_count = max_class_id + 1 - min_class_id; // no +1
-        for (auto& p : csv.points) {
-            int id = (int)p.output.back();
-            p.output.clear();
-            p.output.resize(class_count);
-            p.output[id - min_class_id] = 1.;
+        // the same inputs, one output per class
+        Dataset one_hot(points.size(), points.inputSize(), class_count);
+        for (size_t i = 0; i < points.size(); ++i) {
+            int id = (int)points[i].output.back();
+            std::copy(points[i].input.begin(), points[i].input.end(), one_hot[i].input.begin());
+            one_hot[i].output[id - min_class_id] = 1.;
         }
+        csv.points.swap(one_hot);
 
         if (new_labels) {
             // add indexed labels to 1-hot-enc
@@ -597,19 +628,19 @@ std::vector<DataPoint> loadDataSet(std::string path) {
         }
     }
 
-    return csv.points;
+    return std::move(csv.points);
 }
 
-void loadTrainingSet(std::string path) {
+void loadTrainingSet(CSVData csv) {
     if (training_set_loaded) return;
-    training_set = loadDataSet(path);
+    training_set = makeDataset(std::move(csv));
     teacher->addTrainingDataSet(training_set);
     training_set_loaded = !training_set.empty();
 }
 
-void loadTestingSet(std::string path) {
+void loadTestingSet(CSVData csv) {
     if (testing_set_loaded) return;
-    testing_set = loadDataSet(path);
+    testing_set = makeDataset(std::move(csv));
     teacher->addTestingDataset(testing_set);
     testing_set_loaded = !training_set.empty();
 }
@@ -621,23 +652,11 @@ void showNetworkConfiguration() {
     if (!teacher->network) {
         teacher->addNetwork(std::make_unique<NeuralNetwork>());
     }
-    if (!teacher->last_readable) {
-        teacher->last_readable  = std::make_unique<NeuralNetwork>();
-    }
-    if (!teacher->last_readable_changes) {
-        teacher->last_readable_changes  = std::make_unique<NeuralNetwork>();
-    }
     NeuralNetwork* nn = teacher->network.get();
-    NeuralNetwork* lr = teacher->last_readable.get();
-    NeuralNetwork* lrc = teacher->last_readable_changes.get();
 
     if (nn->layers.size() == 0 && training_set.size() > 0) {
         nn->addLayer(std::make_unique<InputLayer>(
-            training_set[0].input.size()));
-        lr->addLayer(std::make_unique<InputLayer>(
-            training_set[0].input.size()));
-        lrc->addLayer(std::make_unique<InputLayer>(
-            training_set[0].input.size()));
+            training_set.inputSize()));
         teacher->updateLast();
     }
 
@@ -649,6 +668,31 @@ void showNetworkConfiguration() {
     static float learning_rate = 0.05;
     ImGui::InputFloat("Learning rate", &learning_rate, 0.005f);
 
+    static int optimizer_type = 0;
+    ImGui::Combo("Optimizer", &optimizer_type, "SGD\0Momentum\0Nesterov\0RMSProp\0");
+
+    static int training_threads = (int)NNThreadPool::global().size();
+    ImGui::InputInt("Training threads", &training_threads);
+    if (training_threads < 1) training_threads = 1;
+
+    // SGD with the learning rate above, the optimizer is not used then
+    static bool hogwild = false;
+    ImGui::Checkbox("Asynchronous (Hogwild) training", &hogwild);
+
+    // layers split between threads instead of the batch, for deep networks
+    static int pipeline_stages = 1;
+    ImGui::InputInt("Pipeline stages", &pipeline_stages);
+    if (pipeline_stages < 1) pipeline_stages = 1;
+
+    // neurons of the wide layers split between threads, for wide networks
+    static int layer_shards = 1;
+    ImGui::InputInt("Wide layer shards", &layer_shards);
+    if (layer_shards < 1) layer_shards = 1;
+
+    // same results for any number of threads, a bit slower
+    static bool deterministic = false;
+    ImGui::Checkbox("Reproducible training", &deterministic);
+
     ImGui::Separator();
 
     ImGui::Text("Next layer properties: ");
@@ -684,46 +728,26 @@ void showNetworkConfiguration() {
         case 0:
             nn->addLayer(std::make_unique<SigmoidLayer>(
                 next_layer_size, next_layer_bias));
-            lr->addLayer(std::make_unique<SigmoidLayer>(
-                next_layer_size, next_layer_bias));
-            lrc->addLayer(std::make_unique<SigmoidLayer>(
-                next_layer_size, next_layer_bias));
             break;
 
         case 1:
             nn->addLayer(std::make_unique<TanHLayer>(
                 next_layer_size, next_layer_bias));
-            lr->addLayer(std::make_unique<TanHLayer>(
-                next_layer_size, next_layer_bias));
-            lrc->addLayer(std::make_unique<TanHLayer>(
-                next_layer_size, next_layer_bias));
             break;
 
         case 2:
             nn->addLayer(std::make_unique<LinearLayer>(
                 next_layer_size, next_layer_bias));
-            lr->addLayer(std::make_unique<LinearLayer>(
-                next_layer_size, next_layer_bias));
-            lrc->addLayer(std::make_unique<LinearLayer>(
-                next_layer_size, next_layer_bias));
             break;
 
         case 3:
             nn->addLayer(std::make_unique<RampLayer>(
                 next_layer_size, next_layer_bias));
-            lr->addLayer(std::make_unique<RampLayer>(
-                next_layer_size, next_layer_bias));
-            lrc->addLayer(std::make_unique<RampLayer>(
-                next_layer_size, next_layer_bias));
             break;
 
         case 4:
             nn->addLayer(std::make_unique<LeakyRelu>(
                 next_layer_size, next_layer_bias));
-            lr->addLayer(std::make_unique<LeakyRelu>(
-                next_layer_size, next_layer_bias));
-            lrc->addLayer(std::make_unique<LeakyRelu>(
-                next_layer_size, next_layer_bias));
             break;
 
         default:
@@ -738,16 +762,27 @@ void showNetworkConfiguration() {
 
 
     if (ImGui::Button("Add last layer") && training_set.size() > 0) {
-        next_layer_size = training_set[0].output.size();
+        next_layer_size = training_set.outputSize();
         next_layer_bias = false;
         add_layer();
 
         teacher->batch_size = batch_size;
+        teacher->threads = training_threads;
+        teacher->hogwild = hogwild;
+        teacher->deterministic = deterministic;
+        teacher->pipeline_stages = pipeline_stages;
+        teacher->layer_shards = layer_shards;
+        teacher->hogwild_learning_rate = learning_rate;
         if (regression)
             teacher->addLossFunction(std::make_unique<MeanSquaredLossFun>());
         else
             teacher->addLossFunction(std::make_unique<LogLoss>());
-        teacher->addMomentum(std::make_unique<NNSteadyLearningRate>(learning_rate));
+        switch (optimizer_type) {
+        case 1: teacher->addOptimizer(std::make_unique<NNMomentumOptimizer>(learning_rate)); break;
+        case 2: teacher->addOptimizer(std::make_unique<NNNesterovOptimizer>(learning_rate)); break;
+        case 3: teacher->addOptimizer(std::make_unique<NNRMSPropOptimizer>(learning_rate)); break;
+        default: teacher->addOptimizer(std::make_unique<NNSgdOptimizer>(learning_rate)); break;
+        }
         teacher->addTerminator(std::make_unique<NNConstantTerminator>(100000));
         network_initialized = true;
         show_network_configuration = false;
@@ -771,10 +806,7 @@ void showMainWindow() {
      */
 
     auto reset_nn = []() {
-        if (learning_on_side_thread) stop_requested = true;
-        teacher->m.lock();
-        teacher->m.unlock();
-        teacher.release();
+        stopLearning();
         initializeTeacher();
         network_initialized = false;
         show_nn_result_visual = false;
@@ -835,9 +867,15 @@ void showMainWindow() {
 
         if (dataset_chosen != -1) {
             assert(!datasets[dataset_chosen].train_file.empty());
-            loadTrainingSet(datasets[dataset_chosen].train_file);
-            if (!datasets[dataset_chosen].test_file.empty())
-            loadTestingSet(datasets[dataset_chosen].test_file);
+            // both files are read and parsed at once on the thread pool
+            std::string files[2] = {datasets[dataset_chosen].train_file, datasets[dataset_chosen].test_file};
+            CSVData parsed[2];
+            NNThreadPool::global().run(2, [&](size_t i) {
+                if (!files[i].empty()) parsed[i] = loadDataSet(files[i]);
+            });
+            loadTrainingSet(std::move(parsed[0]));
+            if (!files[1].empty())
+            loadTestingSet(std::move(parsed[1]));
             dataset_chosen = -1;
         }
 
@@ -920,7 +958,12 @@ void showMainWindow() {
 
     ImGui::Text("Loss type: %s", teacher->loss_fun ? teacher->loss_fun->getName() : "?");
     ImGui::Text("Batch size: %d", teacher->batch_size);
-    ImGui::Text("%s", teacher->momentum? teacher->momentum->toString().c_str() : "");
+    ImGui::Text("Training threads: %d%s", (int)teacher->threads,
+                teacher->hogwild ? ", asynchronous" : teacher->deterministic ? ", reproducible" : "");
+    if (teacher->optimizer)
+        ImGui::Text("%s", teacher->optimizer->toString().c_str());
+    else
+        ImGui::Text("%s", teacher->momentum? teacher->momentum->toString().c_str() : "");
     ImGui::Checkbox("Show NN visualization", &show_nn_visual);
 
     ImGui::Separator();
@@ -937,7 +980,7 @@ void showMainWindow() {
         }
         ImGui::Text("Current epoch: %d", teacher->getCurrentEpoch());
 
-        if (!learning_on_side_thread && !teacher->finished()) {
+        if (!learningOnSideThread() && !teacher->finished()) {
             if (ImGui::Button("Next batch")) {
                 if (!teacher->hasNextBatch()) teacher->generateBatches();
                 teacher->learnBatch();
@@ -946,41 +989,17 @@ void showMainWindow() {
                 teacher->learnEpoch();
             }
             if (ImGui::Button("10 epochs")) {
-                learning_on_side_thread = true;
-                global_waiter = std::async(std::launch::async, []() {
-                    for (int i = 0; i < 10; ++i) {
-                        if (teacher->finished() || stop_requested.load()) break;
-                        teacher->learnEpoch();
-                    }
-                    stop_requested.store(false);
-                    learning_on_side_thread = false;
-                });
+                startLearning(10);
             }
             if (ImGui::Button("100 epochs")) {
-                learning_on_side_thread = true;
-                global_waiter = std::async(std::launch::async, [](){
-                    for (int i = 0; i < 100; ++i) {
-                        if (teacher->finished() || stop_requested.load()) break;
-                        teacher->learnEpoch();
-                    }
-                    stop_requested.store(false);
-                    learning_on_side_thread = false;
-                });
+                startLearning(100);
             }
             if (ImGui::Button("Continue training")) {
-                learning_on_side_thread = true;
-                global_waiter = std::async(std::launch::async, [](){
-                    for (;;) {
-                        if (teacher->finished() || stop_requested.load()) break;
-                        teacher->learnEpoch();
-                    }
-                    stop_requested.store(false);
-                    learning_on_side_thread = false;
-                });
+                startLearning(-1);
             }
         }
-        if (learning_on_side_thread && ImGui::Button("Pause learning")) {
-            stop_requested.store(true);
+        if (learningOnSideThread() && ImGui::Button("Pause learning")) {
+            training_jobs.cancel();
         }
 
         if (teacher->finished()) {
@@ -997,8 +1016,82 @@ void showMainWindow() {
     ImGui::End();
 }
 
-int main(int, char**)
+// Regression training without the window in workers processes (see
+// NNDistributed.h), each loads the sets and takes its part of every batch,
+// the first one prints the errors of every epoch. Returns the exit code.
+int trainWithWorkers(size_t workers, const std::string& train_file,
+                     const std::string& test_file, size_t epochs) {
+    bool ok = launchWorkers(workers, [&](std::unique_ptr<NNCommunicator> communicator) {
+        size_t rank = communicator->rank();
+        CSVData train = loadDataSet(train_file);
+        if (train.points.empty()) throw std::runtime_error("no data in " + train_file);
+
+        NNTeacher worker;
+        auto nn = std::make_unique<NeuralNetwork>();
+        nn->addLayer(std::make_unique<InputLayer>(train.points.inputSize()));
+        nn->addLayer(std::make_unique<SigmoidLayer>(16));
+        nn->addLayer(std::make_unique<SigmoidLayer>(16));
+        nn->addLayer(std::make_unique<LinearLayer>(train.points.outputSize(), false));
+        nn->initializeWithRandomData();
+        worker.addNetwork(std::move(nn));
+        worker.addLossFunction(std::make_unique<MeanSquaredLossFun>());
+        worker.addOptimizer(std::make_unique<NNSgdOptimizer>(0.05f));
+        worker.addTerminator(std::make_unique<NNConstantTerminator>(epochs));
+        worker.addTrainingDataSet(std::move(train.points));
+        if (!test_file.empty())
+            worker.addTestingDataset(loadDataSet(test_file).points);
+        worker.batch_size = 32;
+        // the workers share the cores
+        worker.threads = std::max<size_t>(NNThreadPool::global().size() / workers, 1);
+        worker.addCommunicator(std::move(communicator));
+        while (!worker.finished())
+            worker.learnEpoch();
+
+        if (rank != 0) return;
+        // complete, the test errors are waited for when the training stops
+        std::vector<float> errors = worker.getErrorHistory();
+        const std::vector<float>& test_errors = worker.error_history_test;
+        for (size_t e = 0; e < errors.size(); ++e) {
+            printf("epoch %zu: training error %g", e + 1, errors[e]);
+            if (e < test_errors.size() && !std::isnan(test_errors[e]))
+                printf(", test error %g", test_errors[e]);
+            printf("\n");
+        }
+    });
+    if (!ok) fprintf(stderr, "training in %zu workers failed\n", workers);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
 {
+    // NeuralNetworkBasic --convert-datasets [directory...]: writes the
+    // binary files of the datasets (of data/ when no directory is given)
+    if (argc > 1 && std::string(argv[1]) == "--convert-datasets") {
+        std::vector<std::string> directories(argv + 2, argv + argc);
+        if (directories.empty()) {
+            preloadDataSets();
+            for (auto* list : {&regression_sets_list, &classification_sets_list})
+                for (auto&& ds : *list)
+                    for (auto* file : {&ds.train_file, &ds.test_file})
+                        if (!file->empty())
+                            directories.push_back(std::filesystem::path(*file).parent_path().string());
+            std::sort(directories.begin(), directories.end());
+            directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+        }
+        for (auto&& directory : directories)
+            printf("%s: %zu converted\n", directory.c_str(), convertDataSetDirectory(directory));
+        return 0;
+    }
+    // NeuralNetworkBasic --workers N train_file [test_file [epochs]]: trains
+    // a regression network in N processes, see trainWithWorkers(); before
+    // anything starts the thread pool, which the workers would not get
+    if (argc > 3 && std::string(argv[1]) == "--workers") {
+        size_t workers = std::max(std::atoi(argv[2]), 1);
+        std::string test_file = argc > 4 ? argv[4] : "";
+        size_t epochs = argc > 5 ? std::max(std::atoi(argv[5]), 1) : 100;
+        return trainWithWorkers(workers, argv[3], test_file, epochs);
+    }
+
     preloadDataSets();
     // Setup window
     glfwSetErrorCallback(glfw_error_callback);
@@ -1131,6 +1224,7 @@ int main(int, char**)
     }
 
     // Cleanup
+    stopLearning();
     ImGui_ImplOpenGL2_Shutdown();
     ImGui_ImplGlfw_Shutdown();
 
@@ -0,0 +1,244 @@
+#include "NNSimd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#include "NNSimdKernels.h"
+
+// Scalar reference kernels, the same math the layers used to do inline.
+// The cheaper accuracy tiers run the generic kernels one float at a time.
+
+namespace {
+
+struct ScalarVec {
+    using reg = float;
+    using mask = bool;
+    static constexpr size_t width = 1;
+
+    static reg load(const float* p) { return *p; }
+    static void store(float* p, reg v) { *p = v; }
+    static reg set1(float f) { return f; }
+    static reg zero() { return 0.0f; }
+
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg div(reg a, reg b) { return a / b; }
+    static reg fma(reg a, reg b, reg c) { return a * b + c; }
+    static reg min(reg a, reg b) { return std::min(a, b); }
+    static reg max(reg a, reg b) { return std::max(a, b); }
+    static reg abs(reg a) { return std::fabs(a); }
+    static reg rcp(reg a) { return 1.0f / a; }
+    static reg sqrt(reg a) { return std::sqrt(a); }
+
+    static reg round(reg a) { return std::nearbyint(a); }
+    static reg pow2(reg n) { return std::ldexp(1.0f, static_cast<int>(n)); }
+    static reg copySign(reg magnitude, reg sign) { return std::copysign(magnitude, sign); }
+
+    static mask less(reg a, reg b) { return a < b; }
+    static reg blend(mask m, reg a, reg b) { return m ? a : b; }
+
+    static float reduceAdd(reg a) { return a; }
+};
+
+} // namespace
+
+static void gemmMicroKernelScalar(size_t kc, const float* a, const float* b,
+                                  float alpha, float beta, float* C, size_t ldc,
+                                  size_t mr, size_t nr) {
+    float acc[gemm_mr][gemm_nr] = {};
+    for (size_t p = 0; p < kc; ++p) {
+        const float* ap = a + p * gemm_mr;
+        const float* bp = b + p * gemm_nr;
+        for (size_t i = 0; i < gemm_mr; ++i)
+            for (size_t j = 0; j < gemm_nr; ++j)
+                acc[i][j] += ap[i] * bp[j];
+    }
+    for (size_t i = 0; i < mr; ++i) {
+        float* c = C + i * ldc;
+        if (beta == 0.0f)
+            for (size_t j = 0; j < nr; ++j) c[j] = alpha * acc[i][j];
+        else
+            for (size_t j = 0; j < nr; ++j) c[j] = alpha * acc[i][j] + beta * c[j];
+    }
+}
+
+static float dotScalar(const float* a, const float* b, size_t n) {
+    float result = 0.0f;
+    for (size_t i = 0; i < n; ++i) result += a[i] * b[i];
+    return result;
+}
+
+static void axpyScalar(float alpha, const float* x, float* y, size_t n) {
+    for (size_t i = 0; i < n; ++i) y[i] += alpha * x[i];
+}
+
+static void sigmoidScalar(const float* in, float* out, size_t n, float slope) {
+    for (size_t i = 0; i < n; ++i) out[i] = 1.0f / (1.0f + expf(-slope * in[i]));
+}
+
+static void tanhScalar(const float* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = tanhf(in[i]);
+}
+
+static void leakyReluScalar(const float* in, float* out, size_t n, float leak) {
+    for (size_t i = 0; i < n; ++i) out[i] = std::max(in[i], leak * in[i]);
+}
+
+static void rampScalar(const float* in, float* out, size_t n, float t1, float t2) {
+    for (size_t i = 0; i < n; ++i) {
+        float x = in[i];
+        if (x < t1) out[i] = 0;
+        else if (x < t2) out[i] = (x - t1) / (t2 - t1);
+        else out[i] = 1;
+    }
+}
+
+static void sigmoidGradientScalar(const float* y, const float* grad, float* delta, size_t n, float slope) {
+    for (size_t i = 0; i < n; ++i) delta[i] = slope * y[i] * (1 - y[i]) * grad[i];
+}
+
+static void tanhGradientScalar(const float* y, const float* grad, float* delta, size_t n) {
+    for (size_t i = 0; i < n; ++i) delta[i] = (1 - y[i] * y[i]) * grad[i];
+}
+
+static void leakyReluGradientScalar(const float* y, const float* grad, float* delta, size_t n, float leak) {
+    for (size_t i = 0; i < n; ++i) delta[i] = grad[i] * (y[i] > 0 ? 1.0f : leak);
+}
+
+static void rampGradientScalar(const float* y, const float* grad, float* delta, size_t n, float scale) {
+    for (size_t i = 0; i < n; ++i) delta[i] = (y[i] > 0 && y[i] < 1 ? scale : 0.0f) * grad[i];
+}
+
+const NNSimdKernels* getScalarKernels() {
+    static const NNSimdKernels kernels {
+        gemmMicroKernelScalar,
+        dotScalar,
+        axpyScalar,
+        {
+            sigmoidScalar,
+            sigmoidKernel<ScalarVec, NNActivationAccuracy::Fast>,
+            sigmoidKernel<ScalarVec, NNActivationAccuracy::Fastest>,
+        },
+        {
+            tanhScalar,
+            tanhKernel<ScalarVec, NNActivationAccuracy::Fast>,
+            tanhKernel<ScalarVec, NNActivationAccuracy::Fastest>,
+        },
+        leakyReluScalar,
+        rampScalar,
+        sigmoidGradientScalar,
+        tanhGradientScalar,
+        leakyReluGradientScalar,
+        rampGradientScalar,
+        gradientNormKernel<ScalarVec>,
+        sgdStepKernel<ScalarVec>,
+        momentumStepKernel<ScalarVec>,
+        nesterovStepKernel<ScalarVec>,
+        rmspropStepKernel<ScalarVec>,
+    };
+    return &kernels;
+}
+
+static bool cpuSupports(NNSimdLevel level) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    switch (level) {
+    case NNSimdLevel::Scalar: return true;
+    case NNSimdLevel::SSE42: return __builtin_cpu_supports("sse4.2");
+    case NNSimdLevel::AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case NNSimdLevel::AVX512: return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    bool sse42 = info[2] & (1 << 20);
+    bool fma = info[2] & (1 << 12);
+    bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) // osxsave, avx
+                  && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = info[1] & (1 << 5);
+    bool avx512f = info[1] & (1 << 16);
+    bool os_avx512 = os_avx && (_xgetbv(0) & 0xe6) == 0xe6;
+    switch (level) {
+    case NNSimdLevel::Scalar: return true;
+    case NNSimdLevel::SSE42: return sse42;
+    case NNSimdLevel::AVX2: return os_avx && avx2 && fma;
+    case NNSimdLevel::AVX512: return os_avx512 && avx512f;
+    }
+    return false;
+#else
+    return level == NNSimdLevel::Scalar;
+#endif
+}
+
+static const NNSimdKernels* getKernels(NNSimdLevel level) {
+    switch (level) {
+    case NNSimdLevel::Scalar: return getScalarKernels();
+    case NNSimdLevel::SSE42: return getSse42Kernels();
+    case NNSimdLevel::AVX2: return getAvx2Kernels();
+    case NNSimdLevel::AVX512: return getAvx512Kernels();
+    }
+    return nullptr;
+}
+
+// level actually usable: supported by the cpu and built in
+static bool isAvailable(NNSimdLevel level) {
+    return getKernels(level) != nullptr && cpuSupports(level);
+}
+
+NNSimdLevel detectSimdLevel() {
+    for (NNSimdLevel level : {NNSimdLevel::AVX512, NNSimdLevel::AVX2, NNSimdLevel::SSE42})
+        if (isAvailable(level)) return level;
+    return NNSimdLevel::Scalar;
+}
+
+static NNSimdLevel initialSimdLevel() {
+    const char* force_scalar = std::getenv("NN_FORCE_SCALAR");
+    if (force_scalar && std::strcmp(force_scalar, "0") != 0)
+        return NNSimdLevel::Scalar;
+    return detectSimdLevel();
+}
+
+static std::atomic<NNSimdLevel>& currentLevel() {
+    static std::atomic<NNSimdLevel> level{initialSimdLevel()};
+    return level;
+}
+
+static std::atomic<const NNSimdKernels*>& currentKernels() {
+    static std::atomic<const NNSimdKernels*> kernels{getKernels(currentLevel().load())};
+    return kernels;
+}
+
+const NNSimdKernels& simd() {
+    return *currentKernels().load(std::memory_order_relaxed);
+}
+
+NNSimdLevel getSimdLevel() {
+    return currentLevel().load();
+}
+
+void setSimdLevel(NNSimdLevel level) {
+    while (level != NNSimdLevel::Scalar && !isAvailable(level))
+        level = static_cast<NNSimdLevel>(static_cast<int>(level) - 1);
+    currentLevel().store(level);
+    currentKernels().store(getKernels(level));
+}
+
+const char* getSimdLevelName(NNSimdLevel level) {
+    switch (level) {
+    case NNSimdLevel::Scalar: return "scalar";
+    case NNSimdLevel::SSE42: return "SSE4.2";
+    case NNSimdLevel::AVX2: return "AVX2";
+    case NNSimdLevel::AVX512: return "AVX-512";
+    }
+    return "?";
+}
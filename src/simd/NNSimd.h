@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+
+// Runtime dispatched SIMD kernels.
+// Every instruction set is built in its own translation unit with matching
+// compiler flags, the best one supported by the cpu is picked on startup.
+// Setting NN_FORCE_SCALAR=1 in the environment (or calling
+// setSimdLevel(NNSimdLevel::Scalar)) forces the scalar reference kernels,
+// which compute exactly what the plain C++ loops did.
+
+enum class NNSimdLevel { Scalar, SSE42, AVX2, AVX512 };
+
+// how closely sigmoid and tanh follow the exact functions,
+// the cheaper tiers are meant for training where a bit of noise is fine
+enum class NNActivationAccuracy {
+    Precise, // about 1 ulp
+    Fast,    // absolute error below 1e-4
+    Fastest, // absolute error below 1e-2 (in practice about 1e-3)
+};
+constexpr size_t activation_accuracy_tiers = 3;
+
+// register tile of the gemm micro-kernels, see NNGemm.cpp
+constexpr size_t gemm_mr = 6;
+constexpr size_t gemm_nr = 16;
+
+// parameters of a single optimizer step, see NNOptimizer.h
+struct NNOptimizerStep {
+    float learning_rate = 0.0f;
+    float clip = 1.0f;     // gradient clipping factor, 1 when not clipping
+    float momentum = 0.0f; // momentum and nesterov
+    float decay = 0.0f;    // rmsprop
+    float epsilon = 0.0f;  // rmsprop
+};
+
+struct NNSimdKernels {
+    // C[0 .. mr)[0 .. nr) = alpha * a * b + beta * C, C is not read when beta is 0
+    // a is a packed gemm_mr x kc sliver, b a packed kc x gemm_nr sliver,
+    // 64-byte aligned (the slivers are loaded with aligned loads)
+    void (*gemm_micro_kernel)(size_t kc, const float* a, const float* b,
+                              float alpha, float beta, float* C, size_t ldc,
+                              size_t mr, size_t nr);
+    float (*dot)(const float* a, const float* b, size_t n);
+    // y += alpha * x
+    void (*axpy)(float alpha, const float* x, float* y, size_t n);
+
+    // activation functions, out may be the same as in,
+    // sigmoid and tanh are indexed by NNActivationAccuracy
+    void (*sigmoid[activation_accuracy_tiers])(const float* in, float* out, size_t n, float slope);
+    void (*tanh[activation_accuracy_tiers])(const float* in, float* out, size_t n);
+    void (*leaky_relu)(const float* in, float* out, size_t n, float leak);
+    void (*ramp)(const float* in, float* out, size_t n, float t1, float t2);
+
+    // delta = f'(x) * grad, with f'(x) computed from the outputs y = f(x)
+    void (*sigmoid_gradient)(const float* y, const float* grad, float* delta, size_t n, float slope);
+    void (*tanh_gradient)(const float* y, const float* grad, float* delta, size_t n);
+    void (*leaky_relu_gradient)(const float* y, const float* grad, float* delta, size_t n, float leak);
+    // scale is 1 / (t2 - t1)
+    void (*ramp_gradient)(const float* y, const float* grad, float* delta, size_t n, float scale);
+
+    // optimizers, each step is a single pass over the weights, the change
+    // made to the weights is written back over grad
+    // sum of squares of -learning_rate * grad, non finite values count as 0
+    float (*gradient_norm)(const float* grad, size_t n, float learning_rate);
+    void (*sgd_step)(float* grad, float* weights, size_t n, const NNOptimizerStep& step);
+    void (*momentum_step)(float* grad, float* weights, float* velocity, size_t n, const NNOptimizerStep& step);
+    void (*nesterov_step)(float* grad, float* weights, float* velocity, size_t n, const NNOptimizerStep& step);
+    void (*rmsprop_step)(float* grad, float* weights, float* mean_square, size_t n, const NNOptimizerStep& step);
+};
+
+// kernels of the currently selected level
+const NNSimdKernels& simd();
+
+// best level supported by both the cpu and the build
+NNSimdLevel detectSimdLevel();
+NNSimdLevel getSimdLevel();
+// selects a level, falls back to the best supported one below it
+void setSimdLevel(NNSimdLevel level);
+const char* getSimdLevelName(NNSimdLevel level);
+
+// tables of the particular instruction sets, nullptr when not built in
+const NNSimdKernels* getScalarKernels();
+const NNSimdKernels* getSse42Kernels();
+const NNSimdKernels* getAvx2Kernels();
+const NNSimdKernels* getAvx512Kernels();
@@ -0,0 +1,112 @@
+// built with -mavx2 -mfma (/arch:AVX2), only called when the cpu supports it
+#include "NNSimd.h"
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+
+#include <immintrin.h>
+
+#include "NNSimdKernels.h"
+
+namespace {
+
+struct Avx2Vec {
+    using reg = __m256;
+    using mask = __m256;
+    static constexpr size_t width = 8;
+
+    static reg load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+    static reg set1(float f) { return _mm256_set1_ps(f); }
+    static reg zero() { return _mm256_setzero_ps(); }
+
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+    static reg fma(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+    static reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+    static reg abs(reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static reg rcp(reg a) { return _mm256_rcp_ps(a); }
+    static reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+
+    static reg round(reg a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static reg pow2(reg n) {
+        __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+    }
+    static reg copySign(reg magnitude, reg sign) {
+        reg sign_bit = _mm256_set1_ps(-0.0f);
+        return _mm256_or_ps(_mm256_andnot_ps(sign_bit, magnitude), _mm256_and_ps(sign_bit, sign));
+    }
+
+    static mask less(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static reg blend(mask m, reg a, reg b) { return _mm256_blendv_ps(b, a, m); }
+
+    static float reduceAdd(reg a) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_movehdup_ps(s));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+} // namespace
+
+// 6 x 16 tile of C in 12 ymm registers
+static void gemmMicroKernelAvx2(size_t kc, const float* a, const float* b,
+                                float alpha, float beta, float* C, size_t ldc,
+                                size_t mr, size_t nr) {
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for (size_t p = 0; p < kc; ++p) {
+        const float* ap = a + p * gemm_mr;
+        __m256 b0 = _mm256_load_ps(b + p * gemm_nr);
+        __m256 b1 = _mm256_load_ps(b + p * gemm_nr + 8);
+        __m256 ai;
+        ai = _mm256_broadcast_ss(ap + 0);
+        c00 = _mm256_fmadd_ps(ai, b0, c00); c01 = _mm256_fmadd_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(ap + 1);
+        c10 = _mm256_fmadd_ps(ai, b0, c10); c11 = _mm256_fmadd_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(ap + 2);
+        c20 = _mm256_fmadd_ps(ai, b0, c20); c21 = _mm256_fmadd_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(ap + 3);
+        c30 = _mm256_fmadd_ps(ai, b0, c30); c31 = _mm256_fmadd_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(ap + 4);
+        c40 = _mm256_fmadd_ps(ai, b0, c40); c41 = _mm256_fmadd_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(ap + 5);
+        c50 = _mm256_fmadd_ps(ai, b0, c50); c51 = _mm256_fmadd_ps(ai, b1, c51);
+    }
+
+    __m256 acc[gemm_mr][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                              {c30, c31}, {c40, c41}, {c50, c51}};
+    if (mr == gemm_mr && nr == gemm_nr) {
+        for (size_t i = 0; i < gemm_mr; ++i) {
+            storeRow<Avx2Vec>(acc[i][0], alpha, beta, C + i * ldc);
+            storeRow<Avx2Vec>(acc[i][1], alpha, beta, C + i * ldc + 8);
+        }
+    } else {
+        alignas(64) float tile[gemm_mr][gemm_nr];
+        for (size_t i = 0; i < gemm_mr; ++i) {
+            _mm256_store_ps(tile[i], acc[i][0]);
+            _mm256_store_ps(tile[i] + 8, acc[i][1]);
+        }
+        storeTile<Avx2Vec>(tile, alpha, beta, C, ldc, mr, nr);
+    }
+}
+
+const NNSimdKernels* getAvx2Kernels() {
+    static const NNSimdKernels kernels = NN_SIMD_KERNEL_TABLE(Avx2Vec, gemmMicroKernelAvx2);
+    return &kernels;
+}
+
+#else
+
+const NNSimdKernels* getAvx2Kernels() { return nullptr; }
+
+#endif
@@ -0,0 +1,110 @@
+// built with -mavx512f -mfma (/arch:AVX512), only called when the cpu supports it
+#include "NNSimd.h"
+
+#if defined(__AVX512F__)
+
+// GCC 12 warns about the undefined source operand the intrinsics pass to
+// the masked builtins (GCC bug 105593), wrongly, whenever they are inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#include "NNSimdKernels.h"
+
+namespace {
+
+struct Avx512Vec {
+    using reg = __m512;
+    using mask = __mmask16;
+    static constexpr size_t width = 16;
+
+    static reg load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, reg v) { _mm512_storeu_ps(p, v); }
+    static reg set1(float f) { return _mm512_set1_ps(f); }
+    static reg zero() { return _mm512_setzero_ps(); }
+
+    static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+    static reg fma(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+    static reg min(reg a, reg b) { return _mm512_min_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm512_max_ps(a, b); }
+    // bitwise float ops need AVX512DQ, go through the integer ones
+    static reg abs(reg a) {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff)));
+    }
+    static reg rcp(reg a) { return _mm512_rcp14_ps(a); }
+    static reg sqrt(reg a) { return _mm512_sqrt_ps(a); }
+
+    static reg round(reg a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static reg pow2(reg n) {
+        __m512i e = _mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+    }
+    static reg copySign(reg magnitude, reg sign) {
+        __m512i sign_bit = _mm512_set1_epi32(0x80000000);
+        return _mm512_castsi512_ps(_mm512_or_si512(
+            _mm512_andnot_si512(sign_bit, _mm512_castps_si512(magnitude)),
+            _mm512_and_si512(sign_bit, _mm512_castps_si512(sign))));
+    }
+
+    static mask less(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static reg blend(mask m, reg a, reg b) { return _mm512_mask_blend_ps(m, b, a); }
+
+    static float reduceAdd(reg a) { return _mm512_reduce_add_ps(a); }
+};
+
+} // namespace
+
+// 6 x 16 tile of C, one zmm register per row
+static void gemmMicroKernelAvx512(size_t kc, const float* a, const float* b,
+                                  float alpha, float beta, float* C, size_t ldc,
+                                  size_t mr, size_t nr) {
+    __m512 c0 = _mm512_setzero_ps(), c1 = _mm512_setzero_ps(), c2 = _mm512_setzero_ps();
+    __m512 c3 = _mm512_setzero_ps(), c4 = _mm512_setzero_ps(), c5 = _mm512_setzero_ps();
+
+    for (size_t p = 0; p < kc; ++p) {
+        const float* ap = a + p * gemm_mr;
+        __m512 bp = _mm512_load_ps(b + p * gemm_nr);
+        c0 = _mm512_fmadd_ps(_mm512_set1_ps(ap[0]), bp, c0);
+        c1 = _mm512_fmadd_ps(_mm512_set1_ps(ap[1]), bp, c1);
+        c2 = _mm512_fmadd_ps(_mm512_set1_ps(ap[2]), bp, c2);
+        c3 = _mm512_fmadd_ps(_mm512_set1_ps(ap[3]), bp, c3);
+        c4 = _mm512_fmadd_ps(_mm512_set1_ps(ap[4]), bp, c4);
+        c5 = _mm512_fmadd_ps(_mm512_set1_ps(ap[5]), bp, c5);
+    }
+
+    __m512 acc[gemm_mr] = {c0, c1, c2, c3, c4, c5};
+    if (nr == gemm_nr) {
+        for (size_t i = 0; i < mr; ++i)
+            storeRow<Avx512Vec>(acc[i], alpha, beta, C + i * ldc);
+    } else {
+        // masked stores instead of going through a tile in memory
+        __mmask16 m = static_cast<__mmask16>((1u << nr) - 1);
+        __m512 va = _mm512_set1_ps(alpha);
+        for (size_t i = 0; i < mr; ++i) {
+            __m512 r = _mm512_mul_ps(va, acc[i]);
+            if (beta != 0.0f)
+                r = _mm512_fmadd_ps(_mm512_set1_ps(beta), _mm512_maskz_loadu_ps(m, C + i * ldc), r);
+            _mm512_mask_storeu_ps(C + i * ldc, m, r);
+        }
+    }
+}
+
+const NNSimdKernels* getAvx512Kernels() {
+    static const NNSimdKernels kernels = NN_SIMD_KERNEL_TABLE(Avx512Vec, gemmMicroKernelAvx512);
+    return &kernels;
+}
+
+#else
+
+const NNSimdKernels* getAvx512Kernels() { return nullptr; }
+
+#endif
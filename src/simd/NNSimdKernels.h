@@ -0,0 +1,412 @@
+#pragma once
+
+// Element-wise kernels written once against a small vector interface V,
+// included by every NNSimd<ISA>.cpp with its own V. Everything here is a
+// template on V and every V is in an anonymous namespace, so the copies
+// built with different instruction sets are local to their files and never
+// get merged by the linker. For the same reason nothing here calls a plain
+// inline function (std::isfinite and the like): an out-of-line copy of it
+// built with AVX could be the one the linker keeps for the whole program.
+//
+// V provides:
+//   reg, mask, width
+//   load, store, set1, zero
+//   add, sub, mul, div, fma (a * b + c), min, max, abs
+//   rcp (approximate 1 / a, at least 12 bits), sqrt
+//   round (to nearest), pow2 (2^n for integral n)
+//   copySign, less (a < b), blend (mask ? a : b), reduceAdd
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "NNSimd.h"
+
+// e^x on the clamped range, reduced to e^r * 2^n with |r| <= ln(2) / 2.
+// Precise is the Cephes polynomial (about 1 ulp), the cheaper tiers use
+// lower degree fits of e^r (Chebyshev nodes), relative error about 1e-4
+// with degree 3 and 2.3e-3 with degree 2.
+template <typename V, NNActivationAccuracy accuracy = NNActivationAccuracy::Precise>
+typename V::reg expV(typename V::reg x) {
+    using reg = typename V::reg;
+    // keeps 2^n a normal float
+    x = V::min(x, V::set1(88.02969f));
+    x = V::max(x, V::set1(-87.33654f));
+
+    reg n = V::round(V::mul(x, V::set1(1.44269504088896341f)));
+    // r = x - n * ln(2), ln(2) split in two for precision
+    reg r = V::fma(n, V::set1(-0.693359375f), x);
+    r = V::fma(n, V::set1(2.12194440e-4f), r);
+
+    reg p;
+    if constexpr (accuracy == NNActivationAccuracy::Precise) {
+        p = V::set1(1.9875691500e-4f);
+        p = V::fma(p, r, V::set1(1.3981999507e-3f));
+        p = V::fma(p, r, V::set1(8.3334519073e-3f));
+        p = V::fma(p, r, V::set1(4.1665795894e-2f));
+        p = V::fma(p, r, V::set1(1.6666665459e-1f));
+        p = V::fma(p, r, V::set1(5.0000001201e-1f));
+        p = V::fma(p, V::mul(r, r), r);
+        p = V::add(p, V::set1(1.0f));
+    } else if constexpr (accuracy == NNActivationAccuracy::Fast) {
+        p = V::set1(1.6767012e-1f);
+        p = V::fma(p, r, V::set1(5.0502228e-1f));
+        p = V::fma(p, r, V::set1(9.9998493e-1f));
+        p = V::fma(p, r, V::set1(9.9992456e-1f));
+    } else {
+        p = V::set1(5.0376483e-1f);
+        p = V::fma(p, r, V::set1(1.0150819f));
+        p = V::fma(p, r, V::set1(1.0f));
+    }
+    return V::mul(p, V::pow2(n));
+}
+
+// 1 / x, the fastest tier makes do with the hardware estimate
+template <typename V, NNActivationAccuracy accuracy>
+typename V::reg reciprocalV(typename V::reg x) {
+    if constexpr (accuracy == NNActivationAccuracy::Fastest)
+        return V::rcp(x);
+    else
+        return V::div(V::set1(1.0f), x);
+}
+
+template <typename V, NNActivationAccuracy accuracy = NNActivationAccuracy::Precise>
+typename V::reg sigmoidV(typename V::reg x, typename V::reg minus_slope) {
+    typename V::reg one = V::set1(1.0f);
+    return reciprocalV<V, accuracy>(V::add(one, expV<V, accuracy>(V::mul(minus_slope, x))));
+}
+
+// Cephes tanhf: odd polynomial near zero, 1 - 2 / (e^2|x| + 1) elsewhere.
+// The cheaper tiers only care about the absolute error, so they skip the
+// polynomial and use the second form everywhere.
+template <typename V, NNActivationAccuracy accuracy = NNActivationAccuracy::Precise>
+typename V::reg tanhV(typename V::reg x) {
+    using reg = typename V::reg;
+    reg ax = V::abs(x);
+    reg one = V::set1(1.0f);
+
+    if constexpr (accuracy != NNActivationAccuracy::Precise) {
+        reg e = expV<V, accuracy>(V::add(ax, ax));
+        reg q = reciprocalV<V, accuracy>(V::add(e, one));
+        return V::copySign(V::sub(one, V::add(q, q)), x);
+    } else {
+        reg s = V::mul(x, x);
+        reg p = V::set1(-5.70498872745e-3f);
+        p = V::fma(p, s, V::set1(2.06390887954e-2f));
+        p = V::fma(p, s, V::set1(-5.37397155531e-2f));
+        p = V::fma(p, s, V::set1(1.33314422036e-1f));
+        p = V::fma(p, s, V::set1(-3.33332819422e-1f));
+        reg small = V::fma(V::mul(p, s), x, x);
+
+        reg e = expV<V>(V::add(ax, ax));
+        reg large = V::sub(one, V::div(V::set1(2.0f), V::add(e, one)));
+        large = V::copySign(large, x);
+
+        return V::blend(V::less(ax, V::set1(0.625f)), small, large);
+    }
+}
+
+// runs op over whole vectors, the tail goes through a zero padded vector
+template <typename V, typename Op>
+void mapV(const float* in, float* out, size_t n, Op op) {
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store(out + i, op(V::load(in + i)));
+    if (i < n) {
+        float tail[V::width] = {};
+        for (size_t j = 0; i + j < n; ++j) tail[j] = in[i + j];
+        V::store(tail, op(V::load(tail)));
+        for (size_t j = 0; i + j < n; ++j) out[i + j] = tail[j];
+    }
+}
+
+// same with two inputs
+template <typename V, typename Op>
+void mapV(const float* a, const float* b, float* out, size_t n, Op op) {
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store(out + i, op(V::load(a + i), V::load(b + i)));
+    if (i < n) {
+        float tail_a[V::width] = {}, tail_b[V::width] = {};
+        for (size_t j = 0; i + j < n; ++j) {
+            tail_a[j] = a[i + j];
+            tail_b[j] = b[i + j];
+        }
+        V::store(tail_a, op(V::load(tail_a), V::load(tail_b)));
+        for (size_t j = 0; i + j < n; ++j) out[i + j] = tail_a[j];
+    }
+}
+
+template <typename V, NNActivationAccuracy accuracy>
+void sigmoidKernel(const float* in, float* out, size_t n, float slope) {
+    typename V::reg minus_slope = V::set1(-slope);
+    mapV<V>(in, out, n, [=](typename V::reg x) { return sigmoidV<V, accuracy>(x, minus_slope); });
+}
+
+template <typename V, NNActivationAccuracy accuracy>
+void tanhKernel(const float* in, float* out, size_t n) {
+    mapV<V>(in, out, n, [](typename V::reg x) { return tanhV<V, accuracy>(x); });
+}
+
+template <typename V>
+void leakyReluKernel(const float* in, float* out, size_t n, float leak) {
+    typename V::reg l = V::set1(leak);
+    mapV<V>(in, out, n, [=](typename V::reg x) { return V::max(x, V::mul(l, x)); });
+}
+
+// (x - t1) / (t2 - t1) clamped to [0, 1]
+template <typename V>
+void rampKernel(const float* in, float* out, size_t n, float t1, float t2) {
+    typename V::reg vt1 = V::set1(t1);
+    typename V::reg scale = V::set1(1.0f / (t2 - t1));
+    typename V::reg zero = V::zero();
+    typename V::reg one = V::set1(1.0f);
+    mapV<V>(in, out, n, [=](typename V::reg x) {
+        return V::min(V::max(V::mul(V::sub(x, vt1), scale), zero), one);
+    });
+}
+
+// Derivatives, from the outputs y of the activation functions.
+// delta = f'(x) * grad, grouped the same way as the scalar versions.
+
+// slope * y * (1 - y)
+template <typename V>
+void sigmoidGradientKernel(const float* y, const float* grad, float* delta, size_t n, float slope) {
+    typename V::reg s = V::set1(slope);
+    typename V::reg one = V::set1(1.0f);
+    mapV<V>(y, grad, delta, n, [=](typename V::reg y, typename V::reg g) {
+        return V::mul(V::mul(V::mul(s, y), V::sub(one, y)), g);
+    });
+}
+
+// 1 - y^2
+template <typename V>
+void tanhGradientKernel(const float* y, const float* grad, float* delta, size_t n) {
+    typename V::reg one = V::set1(1.0f);
+    mapV<V>(y, grad, delta, n, [=](typename V::reg y, typename V::reg g) {
+        return V::mul(V::sub(one, V::mul(y, y)), g);
+    });
+}
+
+// y has the sign of x
+template <typename V>
+void leakyReluGradientKernel(const float* y, const float* grad, float* delta, size_t n, float leak) {
+    typename V::reg l = V::set1(leak);
+    typename V::reg zero = V::zero();
+    mapV<V>(y, grad, delta, n, [=](typename V::reg y, typename V::reg g) {
+        return V::blend(V::less(zero, y), g, V::mul(g, l));
+    });
+}
+
+// scale on the slope (0 < y < 1), 0 on the flat parts
+template <typename V>
+void rampGradientKernel(const float* y, const float* grad, float* delta, size_t n, float scale) {
+    typename V::reg s = V::set1(scale);
+    typename V::reg zero = V::zero();
+    typename V::reg one = V::set1(1.0f);
+    mapV<V>(y, grad, delta, n, [=](typename V::reg y, typename V::reg g) {
+        return V::blend(V::less(zero, y), V::blend(V::less(y, one), V::mul(s, g), zero), zero);
+    });
+}
+
+template <typename V>
+float dotKernel(const float* a, const float* b, size_t n) {
+    // four independent chains to hide the latency of fma
+    typename V::reg acc0 = V::zero(), acc1 = V::zero(), acc2 = V::zero(), acc3 = V::zero();
+    size_t i = 0;
+    for (; i + 4 * V::width <= n; i += 4 * V::width) {
+        acc0 = V::fma(V::load(a + i), V::load(b + i), acc0);
+        acc1 = V::fma(V::load(a + i + V::width), V::load(b + i + V::width), acc1);
+        acc2 = V::fma(V::load(a + i + 2 * V::width), V::load(b + i + 2 * V::width), acc2);
+        acc3 = V::fma(V::load(a + i + 3 * V::width), V::load(b + i + 3 * V::width), acc3);
+    }
+    for (; i + V::width <= n; i += V::width)
+        acc0 = V::fma(V::load(a + i), V::load(b + i), acc0);
+    float result = V::reduceAdd(V::add(V::add(acc0, acc1), V::add(acc2, acc3)));
+    for (; i < n; ++i) result += a[i] * b[i];
+    return result;
+}
+
+template <typename V>
+void axpyKernel(float alpha, const float* x, float* y, size_t n) {
+    typename V::reg va = V::set1(alpha);
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        V::store(y + i, V::fma(va, V::load(x + i), V::load(y + i)));
+    for (; i < n; ++i) y[i] += alpha * x[i];
+}
+
+// Optimizer steps. The gradient g is turned into c = -learning_rate * g,
+// with non finite values replaced by 0, times the clipping factor (the
+// update rules that scale the gradient themselves get g, scrubbed and
+// clipped, instead). The state and the weights are updated in the same
+// pass and the change made to the weights is written back over the gradient.
+
+// scalar isfinite, by the exponent bits
+static inline bool isFiniteScalar(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return (bits & 0x7f800000u) != 0x7f800000u;
+}
+
+template <typename V>
+typename V::reg scrubV(typename V::reg x) {
+    // false for both infinities and NaN
+    return V::blend(V::less(V::abs(x), V::set1(INFINITY)), x, V::zero());
+}
+
+// sum of c^2 before clipping
+template <typename V>
+float gradientNormKernel(const float* grad, size_t n, float learning_rate) {
+    typename V::reg scale = V::set1(-learning_rate);
+    typename V::reg acc0 = V::zero(), acc1 = V::zero();
+    size_t i = 0;
+    for (; i + 2 * V::width <= n; i += 2 * V::width) {
+        typename V::reg c0 = scrubV<V>(V::mul(V::load(grad + i), scale));
+        typename V::reg c1 = scrubV<V>(V::mul(V::load(grad + i + V::width), scale));
+        acc0 = V::fma(c0, c0, acc0);
+        acc1 = V::fma(c1, c1, acc1);
+    }
+    float result = V::reduceAdd(V::add(acc0, acc1));
+    for (; i < n; ++i) {
+        float c = grad[i] * -learning_rate;
+        if (!isFiniteScalar(c)) c = 0;
+        result += c * c;
+    }
+    return result;
+}
+
+// runs op(c, state) over whole vectors, op returns the change of the weights
+// and may update its state (one float per weight, state may be nullptr),
+// the tail goes through zero padded vectors; op gets the gradient without
+// the learning rate when scaled is false
+template <typename V, bool scaled = true, typename Op>
+void optimizerMapV(float* grad, float* weights, float* state, size_t n,
+                   const NNOptimizerStep& step, Op op) {
+    using reg = typename V::reg;
+    reg scale = V::set1(-step.learning_rate);
+    reg clip = V::set1(step.clip);
+    auto body = [&](float* g, float* w, float* s) {
+        reg c;
+        if constexpr (scaled)
+            c = V::mul(scrubV<V>(V::mul(V::load(g), scale)), clip);
+        else
+            c = V::mul(scrubV<V>(V::load(g)), clip);
+        reg st = s ? V::load(s) : V::zero();
+        reg d = op(c, st);
+        if (s) V::store(s, st);
+        V::store(g, d);
+        V::store(w, V::add(V::load(w), d));
+    };
+
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width)
+        body(grad + i, weights + i, state ? state + i : nullptr);
+    if (i < n) {
+        float g[V::width] = {}, w[V::width] = {}, s[V::width] = {};
+        for (size_t j = 0; i + j < n; ++j) {
+            g[j] = grad[i + j];
+            w[j] = weights[i + j];
+            if (state) s[j] = state[i + j];
+        }
+        body(g, w, state ? s : nullptr);
+        for (size_t j = 0; i + j < n; ++j) {
+            grad[i + j] = g[j];
+            weights[i + j] = w[j];
+            if (state) state[i + j] = s[j];
+        }
+    }
+}
+
+template <typename V>
+void sgdStepKernel(float* grad, float* weights, size_t n, const NNOptimizerStep& step) {
+    using reg = typename V::reg;
+    optimizerMapV<V>(grad, weights, nullptr, n, step, [](reg c, reg&) { return c; });
+}
+
+// v = momentum * v + c, the change is v
+template <typename V>
+void momentumStepKernel(float* grad, float* weights, float* velocity, size_t n, const NNOptimizerStep& step) {
+    using reg = typename V::reg;
+    reg mu = V::set1(step.momentum);
+    optimizerMapV<V>(grad, weights, velocity, n, step, [=](reg c, reg& v) {
+        v = V::fma(mu, v, c);
+        return v;
+    });
+}
+
+// v = momentum * v + c, the change is momentum * v + c (looking ahead)
+template <typename V>
+void nesterovStepKernel(float* grad, float* weights, float* velocity, size_t n, const NNOptimizerStep& step) {
+    using reg = typename V::reg;
+    reg mu = V::set1(step.momentum);
+    optimizerMapV<V>(grad, weights, velocity, n, step, [=](reg c, reg& v) {
+        v = V::fma(mu, v, c);
+        return V::fma(mu, v, c);
+    });
+}
+
+// on the gradient g itself: m = decay * m + (1 - decay) * g^2, the change
+// is -learning_rate * g / (sqrt(m) + epsilon)
+template <typename V>
+void rmspropStepKernel(float* grad, float* weights, float* mean_square, size_t n, const NNOptimizerStep& step) {
+    using reg = typename V::reg;
+    reg decay = V::set1(step.decay);
+    reg rest = V::set1(1.0f - step.decay);
+    reg minus_lr = V::set1(-step.learning_rate);
+    reg eps = V::set1(step.epsilon);
+    optimizerMapV<V, false>(grad, weights, mean_square, n, step, [=](reg g, reg& m) {
+        m = V::fma(decay, m, V::mul(rest, V::mul(g, g)));
+        return V::div(V::mul(minus_lr, g), V::add(V::sqrt(m), eps));
+    });
+}
+
+// writes an accumulated tile back to C, used for tiles cut by the edges of C
+template <typename V>
+void storeTile(const float (&tile)[6][16], float alpha, float beta,
+               float* C, size_t ldc, size_t mr, size_t nr) {
+    for (size_t i = 0; i < mr; ++i) {
+        float* c = C + i * ldc;
+        if (beta == 0.0f)
+            for (size_t j = 0; j < nr; ++j) c[j] = alpha * tile[i][j];
+        else
+            for (size_t j = 0; j < nr; ++j) c[j] = alpha * tile[i][j] + beta * c[j];
+    }
+}
+
+// writes one full row of a tile (register acc) to C
+template <typename V>
+void storeRow(typename V::reg acc, float alpha, float beta, float* c) {
+    typename V::reg r = V::mul(V::set1(alpha), acc);
+    if (beta != 0.0f)
+        r = V::fma(V::set1(beta), V::load(c), r);
+    V::store(c, r);
+}
+
+#define NN_SIMD_ACCURACY_TIERS(kernel, V) \
+    { \
+        kernel<V, NNActivationAccuracy::Precise>, \
+        kernel<V, NNActivationAccuracy::Fast>, \
+        kernel<V, NNActivationAccuracy::Fastest>, \
+    }
+
+#define NN_SIMD_KERNEL_TABLE(V, micro_kernel) \
+    NNSimdKernels { \
+        micro_kernel, \
+        dotKernel<V>, \
+        axpyKernel<V>, \
+        NN_SIMD_ACCURACY_TIERS(sigmoidKernel, V), \
+        NN_SIMD_ACCURACY_TIERS(tanhKernel, V), \
+        leakyReluKernel<V>, \
+        rampKernel<V>, \
+        sigmoidGradientKernel<V>, \
+        tanhGradientKernel<V>, \
+        leakyReluGradientKernel<V>, \
+        rampGradientKernel<V>, \
+        gradientNormKernel<V>, \
+        sgdStepKernel<V>, \
+        momentumStepKernel<V>, \
+        nesterovStepKernel<V>, \
+        rmspropStepKernel<V>, \
+    }
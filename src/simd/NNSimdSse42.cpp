@@ -0,0 +1,108 @@
+// built with -msse4.2, only called when the cpu supports it
+#include "NNSimd.h"
+
+#if defined(__SSE4_2__)
+
+#include <nmmintrin.h>
+
+#include "NNSimdKernels.h"
+
+namespace {
+
+struct Sse42Vec {
+    using reg = __m128;
+    using mask = __m128;
+    static constexpr size_t width = 4;
+
+    static reg load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, reg v) { _mm_storeu_ps(p, v); }
+    static reg set1(float f) { return _mm_set1_ps(f); }
+    static reg zero() { return _mm_setzero_ps(); }
+
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+    // no fma before AVX2
+    static reg fma(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+    static reg abs(reg a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static reg rcp(reg a) { return _mm_rcp_ps(a); }
+    static reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+
+    static reg round(reg a) { return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static reg pow2(reg n) {
+        __m128i e = _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+    }
+    static reg copySign(reg magnitude, reg sign) {
+        reg sign_bit = _mm_set1_ps(-0.0f);
+        return _mm_or_ps(_mm_andnot_ps(sign_bit, magnitude), _mm_and_ps(sign_bit, sign));
+    }
+
+    static mask less(reg a, reg b) { return _mm_cmplt_ps(a, b); }
+    static reg blend(mask m, reg a, reg b) { return _mm_blendv_ps(b, a, m); }
+
+    static float reduceAdd(reg a) {
+        __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        s = _mm_add_ss(s, _mm_movehdup_ps(s));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+} // namespace
+
+// 6 x 16 tile of C, done as two 6 x 8 halves so the 12 accumulators
+// of a half fit in the 16 xmm registers
+static void gemmMicroKernelSse42(size_t kc, const float* a, const float* b,
+                                 float alpha, float beta, float* C, size_t ldc,
+                                 size_t mr, size_t nr) {
+    alignas(64) float tile[gemm_mr][gemm_nr];
+    for (size_t half = 0; half < gemm_nr; half += 8) {
+        __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+        __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+        __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+        __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+        __m128 c40 = _mm_setzero_ps(), c41 = _mm_setzero_ps();
+        __m128 c50 = _mm_setzero_ps(), c51 = _mm_setzero_ps();
+
+        for (size_t p = 0; p < kc; ++p) {
+            const float* ap = a + p * gemm_mr;
+            __m128 b0 = _mm_load_ps(b + p * gemm_nr + half);
+            __m128 b1 = _mm_load_ps(b + p * gemm_nr + half + 4);
+            __m128 ai;
+            ai = _mm_set1_ps(ap[0]);
+            c00 = _mm_add_ps(_mm_mul_ps(ai, b0), c00); c01 = _mm_add_ps(_mm_mul_ps(ai, b1), c01);
+            ai = _mm_set1_ps(ap[1]);
+            c10 = _mm_add_ps(_mm_mul_ps(ai, b0), c10); c11 = _mm_add_ps(_mm_mul_ps(ai, b1), c11);
+            ai = _mm_set1_ps(ap[2]);
+            c20 = _mm_add_ps(_mm_mul_ps(ai, b0), c20); c21 = _mm_add_ps(_mm_mul_ps(ai, b1), c21);
+            ai = _mm_set1_ps(ap[3]);
+            c30 = _mm_add_ps(_mm_mul_ps(ai, b0), c30); c31 = _mm_add_ps(_mm_mul_ps(ai, b1), c31);
+            ai = _mm_set1_ps(ap[4]);
+            c40 = _mm_add_ps(_mm_mul_ps(ai, b0), c40); c41 = _mm_add_ps(_mm_mul_ps(ai, b1), c41);
+            ai = _mm_set1_ps(ap[5]);
+            c50 = _mm_add_ps(_mm_mul_ps(ai, b0), c50); c51 = _mm_add_ps(_mm_mul_ps(ai, b1), c51);
+        }
+
+        _mm_store_ps(tile[0] + half, c00); _mm_store_ps(tile[0] + half + 4, c01);
+        _mm_store_ps(tile[1] + half, c10); _mm_store_ps(tile[1] + half + 4, c11);
+        _mm_store_ps(tile[2] + half, c20); _mm_store_ps(tile[2] + half + 4, c21);
+        _mm_store_ps(tile[3] + half, c30); _mm_store_ps(tile[3] + half + 4, c31);
+        _mm_store_ps(tile[4] + half, c40); _mm_store_ps(tile[4] + half + 4, c41);
+        _mm_store_ps(tile[5] + half, c50); _mm_store_ps(tile[5] + half + 4, c51);
+    }
+    storeTile<Sse42Vec>(tile, alpha, beta, C, ldc, mr, nr);
+}
+
+const NNSimdKernels* getSse42Kernels() {
+    static const NNSimdKernels kernels = NN_SIMD_KERNEL_TABLE(Sse42Vec, gemmMicroKernelSse42);
+    return &kernels;
+}
+
+#else
+
+const NNSimdKernels* getSse42Kernels() { return nullptr; }
+
+#endif
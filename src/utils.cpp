@@ -1,4 +1,4 @@
 #include "utils.h"
 #include <random>
 
-std::minstd_rand RNG{123};
+NNRandom RNG{123};
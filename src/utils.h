@@ -1,14 +1,25 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <cstring>
 #include <random>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <sstream>
 
 #include "NNAliases.h"
 #include "DataPoint.h"
+#include "Dataset.h"
+#include "MappedFile.h"
+#include "NNRandom.h"
+#include "NNThreadPool.h"
 
-extern std::minstd_rand RNG;
+// seed of everything random, draw from RNG.stream(...) of your own
+// rather than from RNG itself when on another thread
+extern NNRandom RNG;
 
 inline std::string slurpFile(const std::string& path) {
     constexpr size_t read_size = 4096;
@@ -53,29 +64,114 @@ inline std::vector<std::string> splitText(std::string text, char sep = ' ') {
 
 struct CSVData {
     std::vector<std::string> headers;
-    std::vector<DataPoint> points;
+    Dataset points; // the last column is the output
 };
 
-inline CSVData parseCSV(const std::string& text) {
-    std::istringstream in{text};
-    std::string first_row;
-    CSVData result;
+// one number of a CSV field starting at p, like strtof: leading spaces
+// and a '+' are fine, anything unreadable is 0, returns the end of the
+// field (its comma or end)
+inline const char* parseCSVField(const char* p, const char* end, float& out) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    if (p < end && *p == '+') ++p;
+    auto [number_end, ec] = std::from_chars(p, end, out);
+    if (ec != std::errc{}) {
+        out = 0.0f;
+        number_end = p;
+    }
+    auto comma = static_cast<const char*>(std::memchr(number_end, ',', end - number_end));
+    return comma ? comma : end;
+}
 
-    std::getline(in, first_row, '\n');
-    result.headers = splitText(first_row, ',');
+// end of the line starting at from (its '\n', or end)
+inline const char* findLineEnd(const char* from, const char* end) {
+    if (from == end) return end;
+    auto eol = static_cast<const char*>(std::memchr(from, '\n', end - from));
+    return eol ? eol : end;
+}
 
-    std::string row;
-    while (std::getline(in, row, '\n')) {
-        DataPoint point;
-        auto nums_text = splitText(row, ',');
-        assert(nums_text.size() == result.headers.size());
-        for (auto&& s : nums_text) {
-            point.input.push_back(strtof(s.c_str(), nullptr));
+// the rows of a CSV (see parseCSV) in [begin, end), which starts at the
+// start of a line and ends at the end of one, become the rows of out;
+// throws std::runtime_error for a row without columns fields
+inline void parseCSVRows(const char* begin, const char* end, size_t columns, Dataset& out) {
+    // a row per line at most, the empty ones are dropped at the end
+    out.resize(std::count(begin, end, '\n') + 1, columns - 1, 1);
+    size_t rows = 0;
+    for (const char* p = begin; p < end;) {
+        const char* eol = findLineEnd(p, end);
+        const char* row_end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+        if (row_end != p) {
+            float* input = out.inputs()[rows];
+            float* output = out.outputs()[rows];
+            ++rows;
+            size_t column = 0;
+            for (const char* field = p;; ++field) {
+                float value;
+                field = parseCSVField(field, row_end, value);
+                if (column + 1 < columns) input[column] = value;
+                else if (column + 1 == columns) output[0] = value;
+                ++column;
+                if (field == row_end) break;
+            }
+            if (column != columns) {
+                std::string row(p, std::min<size_t>(row_end - p, 80));
+                throw std::runtime_error("CSV row \"" + row + "\" has " + std::to_string(column)
+                                         + " fields, the header " + std::to_string(columns));
+            }
         }
-        // move last element as output
-        point.output.push_back(point.input.back());
-        point.input.pop_back();
-        result.points.push_back(point);
+        p = eol + (eol < end);
     }
+    out.resizeRows(rows);
+}
+
+// CSV text bigger than that is parsed by several threads
+constexpr size_t csv_chunk_size = 1 << 20;
+
+// the first row names the columns, every other one is a sample with its
+// output in the last column; the numbers are read in place, straight
+// into the points, CRLF line ends and empty lines are fine, a row with
+// another number of fields than the header throws std::runtime_error
+// Big files are cut at line ends into chunks of about chunk_size bytes
+// (csv_chunk_size, smaller ones are for the tests), the chunks are parsed
+// on the thread pool, each into points of its own, which are then copied
+// into place in the order of the file.
+inline CSVData parseCSV(std::string_view text, size_t chunk_size = csv_chunk_size) {
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    CSVData result;
+
+    const char* eol = findLineEnd(begin, end);
+    const char* header_end = eol > begin && eol[-1] == '\r' ? eol - 1 : eol;
+    result.headers = splitText(std::string(begin, header_end), ',');
+    size_t columns = result.headers.size();
+
+    std::vector<const char*> chunk_begin{eol + (eol < end)};
+    chunk_size = std::max<size_t>(chunk_size, 1);
+    while (static_cast<size_t>(end - chunk_begin.back()) > chunk_size) {
+        const char* cut = findLineEnd(chunk_begin.back() + chunk_size, end);
+        chunk_begin.push_back(cut + (cut < end));
+    }
+    if (chunk_begin.back() != end) chunk_begin.push_back(end);
+    size_t chunks = chunk_begin.size() - 1;
+    if (chunks <= 1) {
+        parseCSVRows(chunk_begin.front(), end, columns, result.points);
+        return result;
+    }
+
+    std::vector<Dataset> parsed(chunks);
+    NNThreadPool::global().run(chunks, [&](size_t c) {
+        parseCSVRows(chunk_begin[c], chunk_begin[c + 1], columns, parsed[c]);
+    });
+    std::vector<size_t> offsets(chunks + 1, 0);
+    for (size_t c = 0; c < chunks; ++c) offsets[c + 1] = offsets[c] + parsed[c].size();
+    result.points.resize(offsets.back(), columns - 1, 1);
+    NNThreadPool::global().run(chunks, [&](size_t c) {
+        parsed[c].copyRows(0, parsed[c].size(), result.points, offsets[c]);
+    });
     return result;
+}
+
+// reads a CSV file (see parseCSV) without copying it, it is mapped
+inline CSVData loadCSV(const std::string& path) {
+    MappedFile file{path};
+    return parseCSV(file.view());
 }
\ No newline at end of file
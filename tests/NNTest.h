@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdio>
+
+// Checks for the tests: every test is a program, a failed check is
+// reported and the program returns testResult(), non zero when any failed.
+
+inline int nn_test_failures = 0;
+
+#define NN_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++nn_test_failures; \
+        } \
+    } while (false)
+
+// the same with a message, printf style
+#define NN_CHECK_MSG(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            std::fprintf(stderr, __VA_ARGS__); \
+            std::fprintf(stderr, "\n"); \
+            ++nn_test_failures; \
+        } \
+    } while (false)
+
+inline int testResult() {
+    if (nn_test_failures > 0) std::fprintf(stderr, "%d checks failed\n", nn_test_failures);
+    return nn_test_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+// Sigmoid and tanh of every accuracy tier, on every instruction set the cpu
+// has, against the exact functions (in double): the errors must stay
+// within what NNActivationAccuracy promises.
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "NNTest.h"
+#include "simd/NNSimd.h"
+
+struct Errors {
+    double absolute = 0;
+    double relative = 0;
+};
+
+// of out against exact, relative only where exact is not tiny
+static Errors measure(const std::vector<float>& out, const std::vector<double>& exact) {
+    Errors e;
+    for (size_t i = 0; i < out.size(); ++i) {
+        double diff = std::fabs(out[i] - exact[i]);
+        e.absolute = std::max(e.absolute, diff);
+        if (std::fabs(exact[i]) > 1e-30) e.relative = std::max(e.relative, diff / std::fabs(exact[i]));
+    }
+    return e;
+}
+
+int main() {
+    // dense around 0, out to where both functions are flat
+    std::vector<float> x;
+    for (float v = -40.0f; v <= 40.0f; v += 1.0f / 1024) x.push_back(v);
+    std::vector<double> exact_sigmoid(x.size()), exact_tanh(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        exact_sigmoid[i] = 1.0 / (1.0 + std::exp(-double(x[i])));
+        exact_tanh[i] = std::tanh(double(x[i]));
+    }
+
+    const double max_absolute[] = {1e-6, 1e-4, 1e-2};
+    for (NNSimdLevel level : {NNSimdLevel::Scalar, NNSimdLevel::SSE42, NNSimdLevel::AVX2, NNSimdLevel::AVX512}) {
+        setSimdLevel(level);
+        if (getSimdLevel() != level) continue; // not in this build or on this cpu
+        const NNSimdKernels& kernels = simd();
+        std::vector<float> out(x.size());
+        for (size_t tier = 0; tier < activation_accuracy_tiers; ++tier) {
+            kernels.sigmoid[tier](x.data(), out.data(), x.size(), 1.0f);
+            Errors sigmoid = measure(out, exact_sigmoid);
+            kernels.tanh[tier](x.data(), out.data(), x.size());
+            Errors tanh = measure(out, exact_tanh);
+
+            NN_CHECK_MSG(sigmoid.absolute < max_absolute[tier], "%s tier %zu sigmoid: %g",
+                         getSimdLevelName(level), tier, sigmoid.absolute);
+            NN_CHECK_MSG(tanh.absolute < max_absolute[tier], "%s tier %zu tanh: %g",
+                         getSimdLevelName(level), tier, tanh.absolute);
+            if (tier == size_t(NNActivationAccuracy::Precise)) {
+                // a few ulp everywhere, the tiny values too
+                NN_CHECK_MSG(sigmoid.relative < 1e-6, "%s sigmoid relative: %g",
+                             getSimdLevelName(level), sigmoid.relative);
+                NN_CHECK_MSG(tanh.relative < 1e-6, "%s tanh relative: %g",
+                             getSimdLevelName(level), tanh.relative);
+            }
+        }
+    }
+    return testResult();
+}
@@ -0,0 +1,119 @@
+// Once warmed up, a training step (learnBatch) and a batched evaluation do
+// no heap allocation: every buffer lives in a workspace, the gradients and
+// the optimizer state persist, published snapshots are recycled. Counted
+// by replacing the global operator new.
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+#include "NNTest.h"
+#include "NNTeacher.h"
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, std::align_val_t align) {
+    ++allocations;
+    size_t a = static_cast<size_t>(align);
+    if (void* p = std::aligned_alloc(a, (size + a - 1) / a * a)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t align) { return operator new(size, align); }
+// every operator new above allocates with malloc or aligned_alloc, so free
+// is the matching release; gcc only sees free called on what operator new
+// returned (-Wmismatched-new-delete) and does not know it is replaced here
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static Dataset makeData(size_t n) {
+    Dataset d(n, 3, 2);
+    for (size_t i = 0; i < n; ++i) {
+        auto row = d[i];
+        row.input[0] = std::sin(i * 0.37f);
+        row.input[1] = std::cos(i * 0.11f);
+        row.input[2] = float(i % 7);
+        row.output[0] = row.input[0] * row.input[1];
+        row.output[1] = row.input[0] + row.input[1];
+    }
+    return d;
+}
+
+// allocations made by learnBatch over two epochs, after two epochs of
+// warm-up; a reader holds a snapshot all along and takes a newer one
+// every third step, as the GUI does, slower than the training
+static size_t stepAllocations(size_t threads, std::unique_ptr<NNOptimizer> optimizer) {
+    NNTeacher teacher;
+    auto nn = std::make_unique<NeuralNetwork>();
+    nn->addLayer(std::make_shared<InputLayer>(3));
+    nn->addLayer(std::make_shared<SigmoidLayer>(40));
+    nn->addLayer(std::make_shared<TanHLayer>(20));
+    nn->addLayer(std::make_shared<LinearLayer>(2, false));
+    nn->initializeWithRandomData();
+    teacher.addNetwork(std::move(nn));
+    teacher.addTerminator(std::make_unique<NNConstantTerminator>(10));
+    teacher.addLossFunction(std::make_unique<MeanSquaredLossFun>());
+    teacher.addOptimizer(std::move(optimizer));
+    teacher.addTrainingDataSet(makeData(1000));
+    teacher.batch_size = 64;
+    teacher.sub_batch_size = 16;
+    teacher.threads = threads;
+
+    std::shared_ptr<const NeuralNetwork> reader;
+    size_t counted = 0;
+    size_t steps = 0;
+    for (int epoch = 0; epoch < 4; ++epoch) {
+        teacher.generateBatches();
+        while (teacher.hasNextBatch()) {
+            size_t before = allocations;
+            teacher.learnBatch();
+            if (epoch >= 2) counted += allocations - before;
+            if (steps++ % 3 == 0) reader = teacher.GetLastReadable();
+        }
+    }
+    return counted;
+}
+
+int main() {
+    size_t sgd = stepAllocations(1, std::make_unique<NNSgdOptimizer>(0.01f));
+    NN_CHECK_MSG(sgd == 0, "%zu allocations in learnBatch (sgd)", sgd);
+    size_t rmsprop = stepAllocations(1, std::make_unique<NNRMSPropOptimizer>(0.01f));
+    NN_CHECK_MSG(rmsprop == 0, "%zu allocations in learnBatch (rmsprop)", rmsprop);
+    size_t threaded = stepAllocations(4, std::make_unique<NNMomentumOptimizer>(0.01f, 0.9f));
+    NN_CHECK_MSG(threaded == 0, "%zu allocations in learnBatch (4 threads)", threaded);
+
+    // batched evaluation with a workspace of its own, as the readers do
+    NeuralNetwork nn;
+    nn.addLayer(std::make_shared<InputLayer>(3));
+    nn.addLayer(std::make_shared<SigmoidLayer>(40));
+    nn.addLayer(std::make_shared<LinearLayer>(2, false));
+    nn.initializeWithRandomData();
+    NNWorkspace ws = nn.makeWorkspace();
+    NNMatrix input(32, 3);
+    size_t before = 0;
+    for (int i = 0; i < 10; ++i) {
+        if (i == 2) before = allocations;
+        nn.evaluateBatch(input, ws);
+    }
+    size_t evaluation = allocations - before;
+    NN_CHECK_MSG(evaluation == 0, "%zu allocations in evaluateBatch", evaluation);
+    return testResult();
+}
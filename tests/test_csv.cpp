@@ -0,0 +1,92 @@
+// parseCSV: the header, CRLF and LF line ends, with and without a last
+// line end, empty lines, empty fields and numbers that cannot be read
+// (0, as strtof), and rows with another number of fields than the header,
+// which are an error.
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "NNTest.h"
+#include "utils.h"
+
+// the rows of a parsed CSV, every input then the output
+static std::vector<std::vector<float>> rows(const CSVData& data) {
+    std::vector<std::vector<float>> result;
+    for (size_t r = 0; r < data.points.size(); ++r) {
+        auto row = data.points[r];
+        result.emplace_back(row.input.begin(), row.input.end());
+        result.back().push_back(row.output[0]);
+    }
+    return result;
+}
+
+static void expectRows(const char* what, const std::string& text,
+                       const std::vector<std::vector<float>>& expected) {
+    CSVData data = parseCSV(text);
+    NN_CHECK_MSG((data.headers == std::vector<std::string>{"a", "b", "out"}),
+                 "%s: %zu headers, not a, b and out", what, data.headers.size());
+    NN_CHECK_MSG(rows(data) == expected, "%s: %zu rows, not the expected %zu",
+                 what, data.points.size(), expected.size());
+}
+
+static void expectError(const char* what, const std::string& text, size_t chunk_size = csv_chunk_size) {
+    bool thrown = false;
+    try {
+        parseCSV(text, chunk_size);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    NN_CHECK_MSG(thrown, "%s: no error", what);
+}
+
+// a file of rows of all lengths, parsed in chunks of every size from a
+// byte up, so the cuts fall on every place of a row
+static void checkChunks(const char* what, const std::string& line_end, bool last_line_end) {
+    std::string text = "a,b,out" + line_end;
+    for (int r = 0; r < 60; ++r) {
+        text += std::to_string(r * 0.25f) + "," + std::string(r % 5, ' ') + std::to_string(-r)
+              + "," + std::to_string(r * r * 1001);
+        if (r % 7 == 3) text += line_end; // an empty line
+        if (r < 59 || last_line_end) text += line_end;
+    }
+    const auto serial = rows(parseCSV(text, text.size()));
+    NN_CHECK_MSG(serial.size() == 60, "%s: %zu rows in a single chunk", what, serial.size());
+    for (size_t chunk_size = 1; chunk_size < 80; ++chunk_size)
+        NN_CHECK_MSG(rows(parseCSV(text, chunk_size)) == serial,
+                     "%s: chunks of %zu bytes differ from a single chunk", what, chunk_size);
+    NN_CHECK_MSG(rows(parseCSV(text, 333)) == serial, "%s: chunks of 333 bytes", what);
+    expectError(what, text + line_end + "1,2" + line_end, 16); // in the last chunk
+}
+
+int main() {
+    const std::vector<std::vector<float>> two_rows = {{1, 2, 3}, {4.5f, -5, 6e2f}};
+    expectRows("LF", "a,b,out\n1,2,3\n4.5,-5,6e2\n", two_rows);
+    expectRows("CRLF", "a,b,out\r\n1,2,3\r\n4.5,-5,6e2\r\n", two_rows);
+    expectRows("no last line end", "a,b,out\n1,2,3\n4.5,-5,6e2", two_rows);
+    expectRows("CRLF, no last line end", "a,b,out\r\n1,2,3\r\n4.5,-5,6e2", two_rows);
+    expectRows("empty lines", "a,b,out\n\n1,2,3\r\n\r\n4.5,-5,6e2\n\n", two_rows);
+    expectRows("spaces and a plus", "a,b,out\n 1,\t+2 ,3\n4.5, -5,6e2 \n", two_rows);
+    expectRows("header only", "a,b,out", {});
+    expectRows("header and line end", "a,b,out\r\n", {});
+
+    expectRows("empty fields", "a,b,out\n,2,\n,,\n", {{0, 2, 0}, {0, 0, 0}});
+    expectRows("bad numbers", "a,b,out\nx,2,3\n1,two,3\n1,2,-\n", {{0, 2, 3}, {1, 0, 3}, {1, 2, 0}});
+    expectRows("number and junk", "a,b,out\n1x,2,3\n", {{1, 2, 3}});
+
+    expectError("a field short", "a,b,out\n1,2,3\n4,5\n");
+    expectError("a field too many", "a,b,out\n1,2,3,4\n");
+    expectError("a field short on the last line", "a,b,out\r\n1,2,3\r\n4,5");
+    expectError("a single field", "a,b,out\n7\n");
+
+    checkChunks("LF chunks", "\n", true);
+    checkChunks("LF chunks, no last line end", "\n", false);
+    checkChunks("CRLF chunks", "\r\n", true);
+    checkChunks("CRLF chunks, no last line end", "\r\n", false);
+
+    // parseCSVField stops at the comma of its field
+    const char field[] = " 2.5 ,3";
+    float value = 0;
+    const char* end = parseCSVField(field, field + 7, value);
+    NN_CHECK(value == 2.5f && end == field + 5);
+    return testResult();
+}
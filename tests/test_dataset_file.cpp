@@ -0,0 +1,102 @@
+// Binary dataset files: a set saved and loaded again is the same set, a
+// file cut short anywhere is refused (and the output left alone), and one
+// of another version is refused too, loadDataSet then reads the CSV next
+// to it, or nothing when there is none.
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "DataSetFile.h"
+#include "NNTest.h"
+
+namespace fs = std::filesystem;
+
+static CSVData makeSet() {
+    CSVData data;
+    data.headers = {"x", "a longer name", "", "out"};
+    data.points.resize(37, 3, 1);
+    for (size_t r = 0; r < data.points.size(); ++r) {
+        auto row = data.points[r];
+        for (size_t c = 0; c < 3; ++c) row.input[c] = std::sin(0.37f * (r * 4 + c));
+        row.output[0] = float(r) - 0.5f;
+    }
+    return data;
+}
+
+static bool sameSet(const CSVData& a, const CSVData& b) {
+    if (a.headers != b.headers || a.points.size() != b.points.size()
+        || a.points.inputSize() != b.points.inputSize() || a.points.outputSize() != b.points.outputSize())
+        return false;
+    for (size_t r = 0; r < a.points.size(); ++r) {
+        auto x = a.points[r];
+        auto y = b.points[r];
+        if (!std::equal(x.input.begin(), x.input.end(), y.input.begin())
+            || !std::equal(x.output.begin(), x.output.end(), y.output.begin()))
+            return false;
+    }
+    return true;
+}
+
+static std::string readFile(const fs::path& path) {
+    std::ifstream in{path, std::ios::binary};
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+static void writeFile(const fs::path& path, const std::string& bytes) {
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out.write(bytes.data(), bytes.size());
+}
+
+int main() {
+    fs::path directory = fs::temp_directory_path() / "nnbasic_test_dataset_file";
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+    const std::string path = (directory / "data.set.train.nnds").string();
+    const CSVData set = makeSet();
+
+    // round trip
+    NN_CHECK(saveDataSetFile(path, set));
+    CSVData loaded;
+    NN_CHECK(loadDataSetFile(path, loaded));
+    NN_CHECK_MSG(sameSet(loaded, set), "the loaded set differs from the saved one");
+    NN_CHECK(sameSet(loadDataSet(path), set));
+
+    // cut short at every length, in the header, the names, the padding and the rows
+    const std::string bytes = readFile(path);
+    size_t refused = 0;
+    for (size_t length = 0; length < bytes.size(); ++length) {
+        writeFile(path, bytes.substr(0, length));
+        CSVData out;
+        out.headers = {"untouched"};
+        if (!loadDataSetFile(path, out) && out.headers == std::vector<std::string>{"untouched"}) ++refused;
+    }
+    NN_CHECK_MSG(refused == bytes.size(), "%zu of %zu cut files refused", refused, bytes.size());
+
+    // another version
+    std::string other_version = bytes;
+    uint32_t version = DataSetFileHeader{}.version + 1;
+    std::memcpy(&other_version[offsetof(DataSetFileHeader, version)], &version, sizeof(version));
+    writeFile(path, other_version);
+    NN_CHECK(!loadDataSetFile(path, loaded));
+    NN_CHECK_MSG(loadDataSet(path).points.empty(), "another version without a CSV loaded something");
+    writeFile(directory / "data.set.train.csv", "x,a longer name,,out\n1,2,3,4\n5,6,7,8\n");
+    CSVData fallback = loadDataSet(path);
+    NN_CHECK_MSG(fallback.points.size() == 2 && fallback.headers.size() == 4
+                 && fallback.points[1].output[0] == 8,
+                 "another version did not fall back to the CSV (%zu rows)", fallback.points.size());
+    NN_CHECK(!hasUpToDateBinary((directory / "data.set.train.csv").string()));
+
+    // a CSV that cannot be parsed loads nothing
+    writeFile(directory / "data.set.train.csv", "x,a longer name,,out\n1,2,3\n");
+    NN_CHECK(loadDataSet(path).points.empty());
+
+    fs::remove_all(directory);
+    return testResult();
+}
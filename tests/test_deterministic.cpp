@@ -0,0 +1,72 @@
+// The deterministic mode ends with the very same weights (memcmp) at 1, 2,
+// 3 and 8 threads: the chunks of a batch are cut by
+// deterministic_chunk_size alone and summed by the same tree. The checks
+// that the other mode and another chunk size do change the weights show
+// that the comparison would see a different order of the additions.
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "NNTest.h"
+#include "NNTeacher.h"
+
+static Dataset makeData(size_t n) {
+    Dataset d(n, 3, 2);
+    for (size_t i = 0; i < n; ++i) {
+        auto row = d[i];
+        row.input[0] = std::sin(i * 0.37f);
+        row.input[1] = std::cos(i * 0.11f);
+        row.input[2] = float(i % 7);
+        row.output[0] = row.input[0] * row.input[1];
+        row.output[1] = row.input[0] + row.input[1];
+    }
+    return d;
+}
+
+// batches of 200 in chunks of 64 (the last one shorter), a last batch of
+// 130, and sub-batches of 48 that do not line up with the chunks
+static std::vector<float> train(size_t threads, bool deterministic, size_t chunk_size = 64) {
+    NNTeacher teacher;
+    auto nn = std::make_unique<NeuralNetwork>();
+    nn->addLayer(std::make_shared<InputLayer>(3));
+    nn->addLayer(std::make_shared<SigmoidLayer>(24));
+    nn->addLayer(std::make_shared<TanHLayer>(12));
+    nn->addLayer(std::make_shared<LinearLayer>(2, false));
+    nn->initializeWithRandomData();
+    teacher.addNetwork(std::move(nn));
+    teacher.addTerminator(std::make_unique<NNConstantTerminator>(4));
+    teacher.addLossFunction(std::make_unique<MeanSquaredLossFun>());
+    teacher.addOptimizer(std::make_unique<NNSgdOptimizer>(0.003f));
+    teacher.addTrainingDataSet(makeData(530));
+    teacher.batch_size = 200;
+    teacher.sub_batch_size = 48;
+    teacher.threads = threads;
+    teacher.deterministic = deterministic;
+    teacher.deterministic_chunk_size = chunk_size;
+    while (!teacher.finished())
+        teacher.learnEpoch();
+
+    std::vector<float> weights;
+    for (const NNEdgeMatrix& m : teacher.network->connections)
+        weights.insert(weights.end(), m.data(), m.data() + m.bufferSize());
+    return weights;
+}
+
+static bool sameBits(const std::vector<float>& a, const std::vector<float>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+int main() {
+    const std::vector<float> single = train(1, true);
+    for (size_t threads : {2, 3, 8})
+        NN_CHECK_MSG(sameBits(train(threads, true), single),
+                     "deterministic at %zu threads differs from 1 thread", threads);
+
+    // the shards of the other mode follow the threads, so does the sum
+    NN_CHECK_MSG(!sameBits(train(8, false), train(1, false)),
+                 "8 threads and 1 thread sum the gradient in the same order without the deterministic mode");
+    // the chunks are what sets the order, not the threads
+    NN_CHECK_MSG(!sameBits(train(1, true, 32), single),
+                 "chunks of 32 and of 64 sum the gradient in the same order");
+    return testResult();
+}
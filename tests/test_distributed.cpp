@@ -0,0 +1,110 @@
+// Data-parallel training in 1 to 4 worker processes (launchWorkers) ends
+// with the weights of the same training in a single process: all the
+// workers end up with the same weights, those of one worker are the very
+// same, those of more only differ by the order the gradient is summed in.
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "NNTest.h"
+#include "NNTeacher.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+
+const size_t max_workers = 4;
+const size_t max_weights = 1 << 16; // of a worker, in the shared memory
+
+static Dataset makeData(size_t n) {
+    Dataset d(n, 3, 2);
+    for (size_t i = 0; i < n; ++i) {
+        auto row = d[i];
+        row.input[0] = std::sin(i * 0.37f);
+        row.input[1] = std::cos(i * 0.11f);
+        row.input[2] = float(i % 7);
+        row.output[0] = row.input[0] * row.input[1];
+        row.output[1] = row.input[0] + row.input[1];
+    }
+    return d;
+}
+
+// one thread, so a single process adds the gradient of a batch up in order;
+// a small learning rate, large steps would blow the rounding up
+static std::vector<float> train(std::unique_ptr<NNCommunicator> communicator) {
+    NNTeacher teacher;
+    auto nn = std::make_unique<NeuralNetwork>();
+    nn->addLayer(std::make_shared<InputLayer>(3));
+    nn->addLayer(std::make_shared<SigmoidLayer>(24));
+    nn->addLayer(std::make_shared<LinearLayer>(2, false));
+    nn->initializeWithRandomData();
+    teacher.addNetwork(std::move(nn));
+    teacher.addTerminator(std::make_unique<NNConstantTerminator>(5));
+    teacher.addLossFunction(std::make_unique<MeanSquaredLossFun>());
+    teacher.addOptimizer(std::make_unique<NNSgdOptimizer>(0.003f));
+    // a last batch smaller than the workers, some of them have no part of it
+    teacher.addTrainingDataSet(makeData(502));
+    teacher.batch_size = 50;
+    teacher.threads = 1;
+    if (communicator) teacher.addCommunicator(std::move(communicator));
+    while (!teacher.finished())
+        teacher.learnEpoch();
+
+    std::vector<float> weights;
+    for (const NNEdgeMatrix& m : teacher.network->connections)
+        weights.insert(weights.end(), m.data(), m.data() + m.bufferSize());
+    return weights;
+}
+
+int main() {
+    // the workers leave their weights here, the thread pool of this
+    // process must not start before the last of them is forked
+    void* memory = mmap(nullptr, max_workers * max_weights * sizeof(float),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    NN_CHECK(memory != MAP_FAILED);
+    if (memory == MAP_FAILED) return testResult();
+    float* shared = static_cast<float*>(memory);
+
+    std::vector<std::vector<std::vector<float>>> results(max_workers + 1);
+    for (size_t workers = 1; workers <= max_workers; ++workers) {
+        bool ok = launchWorkers(workers, [&](std::unique_ptr<NNCommunicator> communicator) {
+            size_t rank = communicator->rank();
+            std::vector<float> weights = train(std::move(communicator));
+            if (weights.size() > max_weights) throw std::runtime_error("too many weights");
+            std::copy(weights.begin(), weights.end(), shared + rank * max_weights);
+        });
+        NN_CHECK_MSG(ok, "%zu workers failed", workers);
+        results[workers].assign(workers, {});
+        for (size_t rank = 0; rank < workers; ++rank)
+            results[workers][rank].assign(shared + rank * max_weights, shared + (rank + 1) * max_weights);
+    }
+    munmap(memory, max_workers * max_weights * sizeof(float));
+
+    std::vector<float> single = train(nullptr);
+    single.resize(max_weights);
+    float largest = 0;
+    for (float w : single) largest = std::max(largest, std::fabs(w));
+
+    for (size_t workers = 1; workers <= max_workers; ++workers) {
+        const auto& first = results[workers][0];
+        for (size_t rank = 1; rank < workers; ++rank)
+            NN_CHECK_MSG(results[workers][rank] == first, "%zu workers: rank %zu differs from rank 0",
+                         workers, rank);
+        float difference = 0;
+        for (size_t i = 0; i < single.size(); ++i)
+            difference = std::max(difference, std::fabs(first[i] - single[i]));
+        if (workers == 1)
+            NN_CHECK_MSG(difference == 0, "1 worker: %g from a single process", difference);
+        else
+            NN_CHECK_MSG(difference <= 1e-5f * largest, "%zu workers: %g from a single process (largest weight %g)",
+                         workers, difference, largest);
+    }
+    return testResult();
+}
+
+#else
+
+int main() {
+    return 0; // no fork, no workers
+}
+
+#endif
@@ -0,0 +1,154 @@
+// gemm and gemv against plain loops in double, on every instruction set:
+// sizes that are not multiples of the register tile or of the cache blocks,
+// all the transpositions, the special alphas and betas, K = 0 and the
+// epilogue (which must see every element once, with its final value).
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "NNGemm.h"
+#include "NNTest.h"
+#include "simd/NNSimd.h"
+
+// a matrix of rows x cols with a stride larger than cols, the padding is
+// filled with NaN, which would show up anywhere it is read
+struct Matrix {
+    size_t rows, cols, ld;
+    std::vector<float> data;
+    Matrix(size_t rows, size_t cols, unsigned seed)
+        : rows{rows}, cols{cols}, ld{cols + 3}, data(std::max<size_t>(rows, 1) * (cols + 3), NAN) {
+        for (size_t r = 0; r < rows; ++r)
+            for (size_t c = 0; c < cols; ++c)
+                at(r, c) = std::sin(0.37f * (r * 31 + c * 7 + seed)) * 2;
+    }
+    float& at(size_t r, size_t c) { return data[r * ld + c]; }
+    float at(size_t r, size_t c) const { return data[r * ld + c]; }
+};
+
+struct Epilogue {
+    std::vector<int> seen; // times every element of C was handed over
+    size_t ldc;
+    const float* C;
+    static void apply(const void* context, float* block, size_t ldc, size_t rows, size_t cols) {
+        auto self = static_cast<Epilogue*>(const_cast<void*>(context));
+        size_t offset = block - self->C;
+        for (size_t r = 0; r < rows; ++r)
+            for (size_t c = 0; c < cols; ++c) {
+                ++self->seen[offset + r * ldc + c];
+                block[r * ldc + c] = 2 * block[r * ldc + c] + 1;
+            }
+    }
+};
+
+static size_t failures_reported = 0;
+
+static void checkGemm(const char* level, bool trans_a, bool trans_b, size_t M, size_t N, size_t K,
+                      float alpha, float beta, bool with_epilogue) {
+    Matrix A = trans_a ? Matrix(K, M, 1) : Matrix(M, K, 1);
+    Matrix B = trans_b ? Matrix(N, K, 2) : Matrix(K, N, 2);
+    Matrix C(M, N, 3);
+    if (beta == 0.0f)
+        for (size_t r = 0; r < M; ++r)
+            for (size_t c = 0; c < N; ++c) C.at(r, c) = NAN; // must not be read
+
+    std::vector<double> expected(M * N), bound(M * N);
+    for (size_t i = 0; i < M; ++i)
+        for (size_t j = 0; j < N; ++j) {
+            double sum = 0, magnitude = 0;
+            for (size_t p = 0; p < K; ++p) {
+                double a = trans_a ? A.at(p, i) : A.at(i, p);
+                double b = trans_b ? B.at(j, p) : B.at(p, j);
+                sum += a * b;
+                magnitude += std::fabs(a * b);
+            }
+            double c = beta == 0.0f ? 0.0 : beta * double(C.at(i, j));
+            expected[i * N + j] = alpha * sum + c;
+            bound[i * N + j] = 1e-6 * (std::fabs(alpha) * magnitude + std::fabs(c)) + 1e-30;
+            if (with_epilogue) {
+                expected[i * N + j] = 2 * expected[i * N + j] + 1;
+                bound[i * N + j] = 2 * bound[i * N + j] + 1e-6 * std::fabs(expected[i * N + j]);
+            }
+        }
+
+    Epilogue epilogue{std::vector<int>(C.data.size(), 0), C.ld, C.data.data()};
+    NNGemmEpilogue hook{&Epilogue::apply, &epilogue};
+    gemm(trans_a, trans_b, M, N, K, alpha, A.data.data(), A.ld, B.data.data(), B.ld,
+         beta, C.data.data(), C.ld, with_epilogue ? &hook : nullptr);
+
+    size_t wrong = 0, wrongly_seen = 0;
+    for (size_t i = 0; i < M; ++i)
+        for (size_t j = 0; j < N; ++j) {
+            double error = std::fabs(C.at(i, j) - expected[i * N + j]);
+            if (!(error <= bound[i * N + j])) ++wrong;
+            if (with_epilogue && epilogue.seen[i * C.ld + j] != 1) ++wrongly_seen;
+        }
+    for (size_t i = 0; i < C.data.size(); ++i)
+        if (i % C.ld >= N && epilogue.seen[i] != 0) ++wrongly_seen;
+    NN_CHECK_MSG(wrong == 0 && wrongly_seen == 0,
+                 "%s gemm(%d, %d, M %zu, N %zu, K %zu, alpha %g, beta %g, epilogue %d): "
+                 "%zu wrong, %zu seen by the epilogue not once",
+                 level, trans_a, trans_b, M, N, K, alpha, beta, with_epilogue, wrong, wrongly_seen);
+    if (wrong || wrongly_seen) ++failures_reported;
+}
+
+static void checkGemv(const char* level, bool trans, size_t M, size_t N, float alpha, float beta) {
+    Matrix A(M, N, 4);
+    size_t in = trans ? M : N, out = trans ? N : M;
+    std::vector<float> x(in), y(out, beta == 0.0f ? NAN : 0.5f);
+    for (size_t i = 0; i < in; ++i) x[i] = std::cos(0.3f * i);
+    size_t wrong = 0;
+    std::vector<double> expected(out), bound(out);
+    for (size_t o = 0; o < out; ++o) {
+        double sum = 0, magnitude = 0;
+        for (size_t i = 0; i < in; ++i) {
+            double a = trans ? A.at(i, o) : A.at(o, i);
+            sum += a * x[i];
+            magnitude += std::fabs(a * x[i]);
+        }
+        double c = beta == 0.0f ? 0.0 : beta * double(y[o]);
+        expected[o] = alpha * sum + c;
+        bound[o] = 1e-6 * (std::fabs(alpha) * magnitude + std::fabs(c)) + 1e-30;
+    }
+    gemv(trans, M, N, alpha, A.data.data(), A.ld, x.data(), beta, y.data());
+    for (size_t o = 0; o < out; ++o)
+        if (!(std::fabs(y[o] - expected[o]) <= bound[o])) ++wrong;
+    NN_CHECK_MSG(wrong == 0, "%s gemv(%d, M %zu, N %zu, alpha %g, beta %g): %zu wrong",
+                 level, trans, M, N, alpha, beta, wrong);
+}
+
+int main() {
+    for (NNSimdLevel level : {NNSimdLevel::Scalar, NNSimdLevel::SSE42, NNSimdLevel::AVX2, NNSimdLevel::AVX512}) {
+        setSimdLevel(level);
+        if (getSimdLevel() != level) continue;
+        const char* name = getSimdLevelName(level);
+
+        // edges of the 6 x 16 tile, of the K blocks of 256 and of the M blocks of 96
+        for (size_t M : {1, 7, 100})
+        for (size_t N : {1, 17, 40})
+        for (size_t K : {0, 1, 257, 600})
+        for (int trans = 0; trans < 4; ++trans)
+        for (float beta : {0.0f, 1.0f, -0.5f}) {
+            checkGemm(name, trans & 1, trans & 2, M, N, K, 1.0f, beta, false);
+            if (failures_reported > 20) return testResult();
+        }
+        for (int trans = 0; trans < 4; ++trans)
+        for (float alpha : {0.0f, -0.75f})
+        for (float beta : {0.0f, 1.0f, 2.0f})
+            checkGemm(name, trans & 1, trans & 2, 13, 33, 300, alpha, beta, false);
+        // the epilogue, with one block of K, several, and none
+        for (size_t K : {0, 5, 600})
+        for (int trans = 0; trans < 4; ++trans)
+        for (float beta : {0.0f, 1.0f})
+            checkGemm(name, trans & 1, trans & 2, 100, 40, K, 1.0f, beta, true);
+        // wider than the N blocks of 2048
+        checkGemm(name, false, true, 7, 2050, 3, 1.0f, 0.5f, true);
+
+        for (bool trans : {false, true})
+        for (size_t M : {1, 7, 40})
+        for (size_t N : {1, 17, 33})
+        for (float alpha : {1.0f, 0.0f, -2.0f})
+        for (float beta : {0.0f, 1.0f, 0.25f})
+            checkGemv(name, trans, M, N, alpha, beta);
+    }
+    return testResult();
+}
@@ -0,0 +1,80 @@
+// A network with its wide layers split into shards (NNModelParallel) gives
+// the values, the gradients of the layers and of the connections of the
+// network evaluated as a whole: the values exactly, they come out of the
+// same sums, the gradients within rounding, the gradient of a layer below
+// a split one is added up from the parts of the shards in another order
+// (and so is everything below it).
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "NNModelParallel.h"
+#include "NNTest.h"
+
+// |a - b| <= 1e-6 of the largest element of b, 0 for an exact match
+static float difference(const NNMatrix& a, const NNMatrix& b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) return INFINITY;
+    float largest = 0, worst = 0;
+    for (size_t r = 0; r < b.rows(); ++r)
+        for (size_t c = 0; c < b.cols(); ++c) {
+            largest = std::max(largest, std::fabs(b[r][c]));
+            worst = std::max(worst, std::fabs(a[r][c] - b[r][c]));
+        }
+    return largest > 0 ? worst / largest : worst;
+}
+
+int main() {
+    NeuralNetwork network;
+    network.addLayer(std::make_shared<InputLayer>(5));
+    network.addLayer(std::make_shared<SigmoidLayer>(100)); // split
+    network.addLayer(std::make_shared<TanHLayer>(70));     // split
+    network.addLayer(std::make_shared<LinearLayer>(12));
+    network.addLayer(std::make_shared<LinearLayer>(3, false));
+    network.initializeWithRandomData();
+    size_t layers = network.layers.size();
+
+    const size_t samples = 13;
+    NNMatrix input(samples, 5);
+    for (size_t r = 0; r < samples; ++r)
+        for (size_t c = 0; c < 5; ++c) input[r][c] = std::sin(0.37f * (r * 5 + c));
+
+    for (size_t shards : {2, 3, 5}) {
+        NNModelParallel model_parallel;
+        model_parallel.partition(network, shards, 32);
+        NN_CHECK(model_parallel.shardCount(1) >= 2 && model_parallel.shardCount(2) >= 2);
+        NN_CHECK(model_parallel.shardCount(3) == 0);
+
+        NNWorkspace whole = network.makeWorkspace();
+        NNWorkspace split = network.makeWorkspace();
+        std::vector<NNEdgeMatrix> whole_gradients = network.gradients;
+        std::vector<NNEdgeMatrix> split_gradients = network.gradients;
+        // twice, the second one accumulates
+        for (int pass = 0; pass < 2; ++pass) {
+            network.evaluateBatch(input, whole);
+            split.input = input;
+            model_parallel.evaluateBatch(network, split);
+            for (size_t l = 1; l < layers; ++l)
+                NN_CHECK_MSG(difference(split.layers[l].values, whole.layers[l].values) == 0,
+                             "%zu shards: values of layer %zu differ", shards, l);
+
+            for (NNWorkspace* ws : {&whole, &split}) {
+                NNMatrix& out = ws->outputValues();
+                ws->outputGradient().setShape(out.rows(), out.cols());
+                for (size_t r = 0; r < out.rows(); ++r)
+                    for (size_t c = 0; c < out.cols(); ++c)
+                        ws->outputGradient()[r][c] = out[r][c] - 0.25f * c;
+            }
+            network.gradientDescentBatch(whole, whole_gradients, pass > 0);
+            model_parallel.gradientDescentBatch(network, split, split_gradients, pass > 0);
+            for (size_t l = 0; l + 1 < layers; ++l) {
+                float error = difference(split_gradients[l], whole_gradients[l]);
+                NN_CHECK_MSG(error <= 1e-6f, "%zu shards, pass %d: gradient of connection %zu off by %g",
+                             shards, pass, l, error);
+                error = difference(split.layers[l].gradient, whole.layers[l].gradient);
+                NN_CHECK_MSG(error <= 1e-6f, "%zu shards, pass %d: gradient of layer %zu off by %g",
+                             shards, pass, l, error);
+            }
+        }
+    }
+    return testResult();
+}
@@ -0,0 +1,58 @@
+// The fused optimizer steps of every instruction set against the update
+// rules computed plainly in double.
+#include <cmath>
+#include <vector>
+
+#include "NNTest.h"
+#include "simd/NNSimd.h"
+
+static bool close(double a, double b) {
+    return std::fabs(a - b) <= 1e-5 * std::fabs(b) + 1e-9;
+}
+
+int main() {
+    const size_t n = 37; // whole vectors and a tail on every level
+    for (NNSimdLevel level : {NNSimdLevel::Scalar, NNSimdLevel::SSE42, NNSimdLevel::AVX2, NNSimdLevel::AVX512}) {
+        setSimdLevel(level);
+        if (getSimdLevel() != level) continue;
+        const NNSimdKernels& kernels = simd();
+        const char* name = getSimdLevelName(level);
+
+        // RMSProp over steps with different learning rates: the mean square
+        // follows the gradient alone, the learning rate only scales the change
+        std::vector<float> weights(n, 0.5f), mean_square(n, 0.0f), grad(n);
+        std::vector<double> w_ref(n, 0.5), m_ref(n, 0.0);
+        NNOptimizerStep step;
+        step.decay = 0.9f;
+        step.epsilon = 1e-8f;
+        for (float learning_rate : {0.01f, 0.001f, 0.1f}) {
+            step.learning_rate = learning_rate;
+            std::vector<float> g(n);
+            for (size_t i = 0; i < n; ++i) g[i] = std::sin(i * 0.7f + learning_rate) * (i % 5);
+            grad = g;
+            kernels.rmsprop_step(grad.data(), weights.data(), mean_square.data(), n, step);
+            for (size_t i = 0; i < n; ++i) {
+                m_ref[i] = 0.9 * m_ref[i] + 0.1 * double(g[i]) * g[i];
+                double change = -double(learning_rate) * g[i] / (std::sqrt(m_ref[i]) + 1e-8);
+                w_ref[i] += change;
+                NN_CHECK_MSG(close(mean_square[i], m_ref[i]), "%s rmsprop m[%zu] %g vs %g", name, i, mean_square[i], m_ref[i]);
+                NN_CHECK_MSG(close(grad[i], change), "%s rmsprop change[%zu] %g vs %g", name, i, grad[i], change);
+                NN_CHECK_MSG(close(weights[i], w_ref[i]), "%s rmsprop w[%zu] %g vs %g", name, i, weights[i], w_ref[i]);
+            }
+        }
+
+        // clipping scales the gradient, non finite values count as 0
+        step.learning_rate = 0.1f;
+        step.clip = 0.5f;
+        std::fill(weights.begin(), weights.end(), 0.0f);
+        for (size_t i = 0; i < n; ++i) grad[i] = float(i);
+        grad[3] = INFINITY;
+        grad[n - 1] = NAN;
+        kernels.sgd_step(grad.data(), weights.data(), n, step);
+        for (size_t i = 0; i < n; ++i) {
+            double change = i == 3 || i == n - 1 ? 0.0 : -0.1 * 0.5 * i;
+            NN_CHECK_MSG(close(weights[i], change), "%s sgd w[%zu] %g vs %g", name, i, weights[i], change);
+        }
+    }
+    return testResult();
+}
@@ -0,0 +1,77 @@
+// The gradients of a batch propagated through the stages of NNPipeline are
+// those of a single thread going through the same micro-batches in order,
+// bit for bit, whatever the number of stages and of micro-batches (fewer
+// micro-batches than stages too, and a last one that is shorter).
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "NNPipeline.h"
+#include "NNTest.h"
+
+const size_t micro_size = 9;
+
+static void input(size_t m, size_t count, NNWorkspace& ws) {
+    ws.input.setShape(count, 3);
+    for (size_t r = 0; r < count; ++r)
+        for (size_t c = 0; c < 3; ++c)
+            ws.input[r][c] = std::sin(0.37f * ((m * micro_size + r) * 3 + c));
+}
+
+// gradient of 1/2 (output - target)^2, the target made up of the inputs
+static void loss(NNWorkspace& ws) {
+    NNMatrix& out = ws.outputValues();
+    NNMatrix& gradient = ws.outputGradient();
+    gradient.setShape(out.rows(), out.cols());
+    for (size_t r = 0; r < out.rows(); ++r)
+        for (size_t c = 0; c < out.cols(); ++c)
+            gradient[r][c] = out[r][c] - ws.input[r][c % 3] * 0.5f;
+}
+
+static bool sameBits(const std::vector<NNEdgeMatrix>& a, const std::vector<NNEdgeMatrix>& b) {
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].bufferSize() != b[i].bufferSize()
+            || std::memcmp(a[i].data(), b[i].data(), a[i].bufferSize() * sizeof(float)) != 0)
+            return false;
+    return true;
+}
+
+int main() {
+    NeuralNetwork network;
+    network.addLayer(std::make_shared<InputLayer>(3));
+    network.addLayer(std::make_shared<SigmoidLayer>(20));
+    network.addLayer(std::make_shared<TanHLayer>(16));
+    network.addLayer(std::make_shared<LeakyRelu>(12));
+    network.addLayer(std::make_shared<SigmoidLayer>(8));
+    network.addLayer(std::make_shared<LinearLayer>(4, false));
+    network.initializeWithRandomData();
+    size_t layers = network.layers.size();
+
+    for (size_t samples : {5, 9, 40}) {
+        size_t micro_batches = (samples + micro_size - 1) / micro_size;
+        auto count = [&](size_t m) { return std::min(micro_size, samples - m * micro_size); };
+
+        std::vector<NNEdgeMatrix> sequential = network.gradients;
+        NNWorkspace ws = network.makeWorkspace();
+        for (size_t m = 0; m < micro_batches; ++m) {
+            input(m, count(m), ws);
+            network.evaluateLayers(ws, 0, layers);
+            loss(ws);
+            network.gradientDescentLayers(ws, sequential, 0, layers, m > 0);
+        }
+
+        for (size_t stages = 1; stages <= 4; ++stages) {
+            NNPipeline pipeline;
+            pipeline.partition(network, stages);
+            std::vector<NNEdgeMatrix> pipelined = network.gradients;
+            pipeline.run(network, micro_batches, pipelined,
+                         [&](size_t m, NNWorkspace& w) { input(m, count(m), w); },
+                         [&](size_t, NNWorkspace& w) { loss(w); });
+            NN_CHECK_MSG(sameBits(pipelined, sequential),
+                         "%zu stages, %zu micro-batches: gradients differ from the sequential pass",
+                         pipeline.stageCount(), micro_batches);
+        }
+    }
+    return testResult();
+}
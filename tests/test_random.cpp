@@ -0,0 +1,44 @@
+// Philox4x32-10 against the known-answer vectors of Random123
+// (kat_vectors, "philox4x32 10"), and NNRandom reading its streams
+// from the same rounds.
+#include <cstdint>
+
+#include "NNTest.h"
+#include "NNRandom.h"
+
+struct KnownAnswer {
+    uint32_t counter[4];
+    uint32_t key[2];
+    uint32_t expected[4];
+};
+
+static const KnownAnswer known_answers[] = {
+    {{0x00000000, 0x00000000, 0x00000000, 0x00000000}, {0x00000000, 0x00000000},
+     {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+    {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff},
+     {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+    {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0},
+     {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+};
+
+int main() {
+    for (const KnownAnswer& k : known_answers) {
+        uint32_t out[4];
+        NNRandom::philox(k.counter, k.key, out);
+        for (int i = 0; i < 4; ++i)
+            NN_CHECK_MSG(out[i] == k.expected[i], "counter %08x.., word %d: %08x, expected %08x",
+                         k.counter[0], i, out[i], k.expected[i]);
+
+        // the counter of a stream is (position / 4, use, index), the key the
+        // seed; positions count numbers, 4 a block, so the blocks stop at 2^62
+        uint32_t counter[4] = {k.counter[0], k.counter[1] & 0x3fffffff, k.counter[2], k.counter[3]};
+        uint32_t expected[4];
+        NNRandom::philox(counter, k.key, expected);
+        NNRandom random(k.key[0] | static_cast<uint64_t>(k.key[1]) << 32,
+                        static_cast<NNRandomStream>(counter[2]), counter[3]);
+        random.seek((counter[0] | static_cast<uint64_t>(counter[1]) << 32) * 4);
+        for (int i = 0; i < 4; ++i)
+            NN_CHECK(random() == expected[i]);
+    }
+    return testResult();
+}
@@ -0,0 +1,259 @@
+// The kernel tables of every instruction set the cpu has against the
+// scalar one, the reference:
+//  - the selections (leaky relu, ramp and their gradients) exact or 1 ulp;
+//  - the Precise activations within 4 ulp, the cheaper tiers within twice
+//    their stated absolute errors;
+//  - what fuses a multiply and an add (axpy, the gradients, the optimizer
+//    steps) rounds once less, and a result that nearly cancels can be many
+//    ulp off: within a few ulp of the terms it is made of instead;
+//  - the reductions (dot, the gemm micro-kernel) add up in another order,
+//    so within n ulp of the sum of the absolute values of the terms,
+//    the usual bound of a sum of n products.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "NNTest.h"
+#include "simd/NNSimd.h"
+
+const size_t n = 1003; // whole vectors of every width and a tail
+
+static int64_t ulpDistance(float a, float b) {
+    if (a == b) return 0; // +0 and -0 too
+    if (std::isnan(a) || std::isnan(b)) return std::isnan(a) && std::isnan(b) ? 0 : INT64_MAX;
+    int32_t ia, ib;
+    std::memcpy(&ia, &a, sizeof(a));
+    std::memcpy(&ib, &b, sizeof(b));
+    // ordered as integers, negative floats mirrored below zero
+    int64_t la = ia < 0 ? -int64_t(ia & 0x7fffffff) : ia;
+    int64_t lb = ib < 0 ? -int64_t(ib & 0x7fffffff) : ib;
+    return std::llabs(la - lb);
+}
+
+static std::vector<float> values(float low, float high, unsigned seed) {
+    std::vector<float> v(n);
+    for (size_t i = 0; i < n; ++i)
+        v[i] = low + (high - low) * (0.5f + 0.5f * std::sin(1.7f * i + seed * 0.9f));
+    return v;
+}
+
+struct Compare {
+    const char* level;
+    const char* what;
+    int64_t max_ulp = 0;
+    double max_abs = 0;
+    void add(const std::vector<float>& reference, const std::vector<float>& result) {
+        for (size_t i = 0; i < reference.size(); ++i) {
+            max_ulp = std::max(max_ulp, ulpDistance(reference[i], result[i]));
+            max_abs = std::max(max_abs, double(std::fabs(reference[i] - result[i])));
+        }
+    }
+    void checkUlp(int64_t tolerance) {
+        NN_CHECK_MSG(max_ulp <= tolerance, "%s %s: %lld ulp from scalar, %lld allowed",
+                     level, what, (long long)max_ulp, (long long)tolerance);
+    }
+    void checkAbs(double tolerance) {
+        NN_CHECK_MSG(max_abs <= tolerance, "%s %s: %g from scalar, %g allowed",
+                     level, what, max_abs, tolerance);
+    }
+};
+
+// result of a kernel on a copy of the inputs, for the reference and the tested table
+template <typename F>
+static void compareElementwise(const char* level, const char* what, int64_t ulp, F f) {
+    std::vector<float> reference = f(*getScalarKernels());
+    std::vector<float> result = f(simd());
+    Compare c{level, what};
+    c.add(reference, result);
+    c.checkUlp(ulp);
+}
+
+// |result - reference| <= ulp * 2^-23 * scale, scale the magnitude of the
+// terms of each element (repeated every n for kernels with several outputs)
+template <typename F>
+static void compareScaled(const char* level, const char* what, double ulp,
+                          const std::vector<double>& scale, F f) {
+    std::vector<float> reference = f(*getScalarKernels());
+    std::vector<float> result = f(simd());
+    size_t wrong = 0;
+    for (size_t i = 0; i < reference.size(); ++i)
+        if (!(std::fabs(double(result[i]) - reference[i]) <= ulp * 0x1p-23 * scale[i % n])) ++wrong;
+    NN_CHECK_MSG(wrong == 0, "%s %s: %zu beyond %g ulp of its terms", level, what, wrong, ulp);
+}
+
+// a kc x gemm_nr sliver must be aligned like the packing buffers of gemm
+struct AlignedBuffer {
+    std::vector<float> storage;
+    float* data;
+    explicit AlignedBuffer(size_t size) : storage(size + 16) {
+        uintptr_t p = reinterpret_cast<uintptr_t>(storage.data());
+        data = reinterpret_cast<float*>((p + 63) & ~uintptr_t(63));
+    }
+};
+
+int main() {
+    const std::vector<float> x = values(-8, 8, 1);
+    const std::vector<float> y = values(-3, 3, 2);
+    const std::vector<float> grad = values(-1, 1, 3);
+    const std::vector<float> sigmoid_out = values(0.001f, 0.999f, 4);
+    const std::vector<float> tanh_out = values(-0.999f, 0.999f, 5);
+
+    for (NNSimdLevel level : {NNSimdLevel::SSE42, NNSimdLevel::AVX2, NNSimdLevel::AVX512}) {
+        setSimdLevel(level);
+        if (getSimdLevel() != level) continue;
+        const char* name = getSimdLevelName(level);
+        const NNSimdKernels& scalar = *getScalarKernels();
+        const NNSimdKernels& k = simd();
+
+        // reductions: |dot - reference| <= n * eps * sum |a * b|
+        for (size_t length : {size_t(1), size_t(7), size_t(64), n}) {
+            double magnitude = 0;
+            for (size_t i = 0; i < length; ++i) magnitude += std::fabs(double(x[i]) * y[i]);
+            double error = std::fabs(double(k.dot(x.data(), y.data(), length))
+                                     - double(scalar.dot(x.data(), y.data(), length)));
+            NN_CHECK_MSG(error <= length * 0x1p-23 * magnitude, "%s dot of %zu: %g from scalar",
+                         name, length, error);
+        }
+        {
+            size_t kc = 257;
+            std::vector<float> a(gemm_mr * kc);
+            AlignedBuffer packed_b(gemm_nr * kc);
+            float* b = packed_b.data;
+            for (size_t i = 0; i < a.size(); ++i) a[i] = x[i % n];
+            for (size_t i = 0; i < gemm_nr * kc; ++i) b[i] = y[(i * 7) % n];
+            const size_t ldc = gemm_nr + 5;
+            for (float beta : {0.0f, 1.0f, -0.5f})
+            for (size_t mr : {gemm_mr, size_t(1), size_t(5)})
+            for (size_t nr : {gemm_nr, size_t(1), size_t(9)}) {
+                std::vector<float> c_ref(gemm_mr * ldc), c(gemm_mr * ldc);
+                for (size_t i = 0; i < c.size(); ++i) c_ref[i] = c[i] = grad[i % n];
+                scalar.gemm_micro_kernel(kc, a.data(), b, 0.75f, beta, c_ref.data(), ldc, mr, nr);
+                k.gemm_micro_kernel(kc, a.data(), b, 0.75f, beta, c.data(), ldc, mr, nr);
+                size_t wrong = 0;
+                for (size_t i = 0; i < gemm_mr; ++i)
+                    for (size_t j = 0; j < ldc; ++j) {
+                        double bound = 0;
+                        if (i < mr && j < nr) {
+                            for (size_t p = 0; p < kc; ++p)
+                                bound += std::fabs(0.75 * a[p * gemm_mr + i] * b[p * gemm_nr + j]);
+                            bound = (kc + 2) * 0x1p-23 * (bound + std::fabs(beta * grad[(i * ldc + j) % n]));
+                        }
+                        // outside the mr x nr tile C must stay as it was
+                        if (!(std::fabs(double(c[i * ldc + j]) - c_ref[i * ldc + j]) <= bound)) ++wrong;
+                    }
+                NN_CHECK_MSG(wrong == 0, "%s gemm micro-kernel (mr %zu, nr %zu, beta %g): %zu wrong",
+                             name, mr, nr, beta, wrong);
+            }
+        }
+
+        std::vector<double> axpy_scale(n);
+        for (size_t i = 0; i < n; ++i) axpy_scale[i] = std::fabs(0.37 * x[i]) + std::fabs(y[i]);
+        compareScaled(name, "axpy", 2, axpy_scale, [&](const NNSimdKernels& t) {
+            std::vector<float> out = y;
+            t.axpy(0.37f, x.data(), out.data(), n);
+            return out;
+        });
+
+        const char* tiers[] = {"Precise", "Fast", "Fastest"};
+        const double tier_error[] = {0, 2e-4, 2e-2}; // twice the error of each against exact
+        for (size_t tier = 0; tier < activation_accuracy_tiers; ++tier) {
+            std::vector<float> ref(n), out(n);
+            Compare c{name, "sigmoid"};
+            scalar.sigmoid[tier](x.data(), ref.data(), n, 1.0f);
+            k.sigmoid[tier](x.data(), out.data(), n, 1.0f);
+            c.add(ref, out);
+            Compare t{name, "tanh"};
+            scalar.tanh[tier](x.data(), ref.data(), n);
+            k.tanh[tier](x.data(), out.data(), n);
+            t.add(ref, out);
+            if (tier == 0) {
+                c.checkUlp(4);
+                t.checkUlp(4);
+            } else {
+                NN_CHECK_MSG(c.max_abs <= tier_error[tier] && t.max_abs <= tier_error[tier],
+                             "%s %s tier: sigmoid %g, tanh %g from scalar", name, tiers[tier],
+                             c.max_abs, t.max_abs);
+            }
+        }
+        compareElementwise(name, "leaky relu", 0, [&](const NNSimdKernels& t) {
+            std::vector<float> out(n);
+            t.leaky_relu(x.data(), out.data(), n, 0.01f);
+            return out;
+        });
+        compareElementwise(name, "ramp", 1, [&](const NNSimdKernels& t) {
+            std::vector<float> out(n);
+            t.ramp(x.data(), out.data(), n, -1.0f, 2.0f);
+            return out;
+        });
+        compareElementwise(name, "sigmoid gradient", 2, [&](const NNSimdKernels& t) {
+            std::vector<float> out(n);
+            t.sigmoid_gradient(sigmoid_out.data(), grad.data(), out.data(), n, 1.0f);
+            return out;
+        });
+        std::vector<double> tanh_scale(n);
+        for (size_t i = 0; i < n; ++i)
+            tanh_scale[i] = (1 + double(tanh_out[i]) * tanh_out[i]) * std::fabs(grad[i]);
+        compareScaled(name, "tanh gradient", 4, tanh_scale, [&](const NNSimdKernels& t) {
+            std::vector<float> out(n);
+            t.tanh_gradient(tanh_out.data(), grad.data(), out.data(), n);
+            return out;
+        });
+        compareElementwise(name, "leaky relu gradient", 0, [&](const NNSimdKernels& t) {
+            std::vector<float> out(n);
+            t.leaky_relu_gradient(x.data(), grad.data(), out.data(), n, 0.01f);
+            return out;
+        });
+        compareElementwise(name, "ramp gradient", 0, [&](const NNSimdKernels& t) {
+            std::vector<float> out(n);
+            t.ramp_gradient(x.data(), grad.data(), out.data(), n, 1.0f / 3);
+            return out;
+        });
+
+        NNOptimizerStep step;
+        step.learning_rate = 0.05f;
+        step.clip = 0.5f;
+        step.momentum = 0.9f;
+        step.decay = 0.9f;
+        step.epsilon = 1e-7f;
+        // the weights after a step and the change left in grad
+        auto weightsAndChange = [&](std::vector<float> weights, std::vector<float> change) {
+            weights.insert(weights.end(), change.begin(), change.end());
+            return weights;
+        };
+        compareElementwise(name, "sgd step", 2, [&](const NNSimdKernels& t) {
+            std::vector<float> g = grad, w = y;
+            t.sgd_step(g.data(), w.data(), n, step);
+            return weightsAndChange(w, g);
+        });
+        // the weights, the velocity and the change are all made of these
+        const std::vector<float> velocity = values(-0.1f, 0.1f, 6);
+        std::vector<double> step_scale(n);
+        for (size_t i = 0; i < n; ++i)
+            step_scale[i] = std::fabs(y[i]) + 2 * (std::fabs(velocity[i]) + std::fabs(step.learning_rate * grad[i]));
+        compareScaled(name, "momentum step", 4, step_scale, [&](const NNSimdKernels& t) {
+            std::vector<float> g = grad, w = y, v = velocity;
+            t.momentum_step(g.data(), w.data(), v.data(), n, step);
+            return weightsAndChange(weightsAndChange(w, g), v);
+        });
+        compareScaled(name, "nesterov step", 4, step_scale, [&](const NNSimdKernels& t) {
+            std::vector<float> g = grad, w = y, v = velocity;
+            t.nesterov_step(g.data(), w.data(), v.data(), n, step);
+            return weightsAndChange(weightsAndChange(w, g), v);
+        });
+        compareElementwise(name, "rmsprop step", 4, [&](const NNSimdKernels& t) {
+            std::vector<float> g = grad, w = y, m = values(0.0f, 0.2f, 7);
+            t.rmsprop_step(g.data(), w.data(), m.data(), n, step);
+            return weightsAndChange(weightsAndChange(w, g), m);
+        });
+        {
+            double reference = scalar.gradient_norm(grad.data(), n, step.learning_rate);
+            double result = k.gradient_norm(grad.data(), n, step.learning_rate);
+            NN_CHECK_MSG(std::fabs(result - reference) <= n * 0x1p-23 * reference,
+                         "%s gradient norm: %g, scalar %g", name, result, reference);
+        }
+    }
+    return testResult();
+}
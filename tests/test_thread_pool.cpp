@@ -0,0 +1,109 @@
+// A thread waiting for a group runs only the tasks of that group, and the
+// jobs still queued when the pool is destroyed are cancelled. Pinned tasks
+// run on their worker call after call, unless it is busy.
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "NNTest.h"
+#include "NNThreadPool.h"
+
+using namespace std::chrono_literals;
+
+// waits for release, for at most a second
+static void hold(const std::atomic<bool>& release) {
+    auto until = std::chrono::steady_clock::now() + 1s;
+    while (!release && std::chrono::steady_clock::now() < until)
+        std::this_thread::yield();
+}
+
+static void waitOnlyForOwnGroup() {
+    NNThreadPool pool(1);
+    std::atomic<bool> release{false};
+    std::atomic<size_t> started{0};
+    std::atomic<size_t> ran_on_main{0};
+    const auto main_thread = std::this_thread::get_id();
+
+    // a caller of its own keeps the worker busy and leaves tasks queued
+    std::thread other([&] {
+        pool.run(4, [&](size_t) {
+            ++started;
+            if (std::this_thread::get_id() == main_thread) ++ran_on_main;
+            hold(release);
+        });
+    });
+    while (started < 2) std::this_thread::yield();
+
+    std::atomic<size_t> done{0};
+    pool.run(4, [&](size_t) { ++done; });
+    NN_CHECK(done == 4);
+    release = true;
+    other.join();
+    NN_CHECK(started == 4);
+    NN_CHECK_MSG(ran_on_main == 0, "%zu tasks of another group run by a waiting thread",
+                 ran_on_main.load());
+}
+
+static void cancelQueuedJobs() {
+    std::atomic<bool> release{false};
+    std::atomic<bool> first_ran{false};
+    std::atomic<bool> second_ran{false};
+    NNTaskGroup first;
+    NNTaskGroup second;
+    std::thread releaser;
+    {
+        NNThreadPool pool(1);
+        pool.submit(first, [&] {
+            first_ran = true;
+            hold(release);
+        });
+        while (!first_ran) std::this_thread::yield();
+        pool.submit(second, [&] { second_ran = true; });
+        releaser = std::thread([&] {
+            std::this_thread::sleep_for(50ms);
+            release = true;
+        });
+    }
+    releaser.join();
+    NN_CHECK(first.done());
+    NN_CHECK(second.done());
+    NN_CHECK(second.cancelled());
+    NN_CHECK(!second_ran);
+}
+
+static void pinnedTasks() {
+    NNThreadPool pool(3);
+    std::vector<std::thread::id> first(7), again(7);
+    pool.runPinned(7, [&](size_t i) { first[i] = std::this_thread::get_id(); });
+    pool.runPinned(7, [&](size_t i) { again[i] = std::this_thread::get_id(); });
+    const auto main_thread = std::this_thread::get_id();
+    for (size_t i = 0; i < 7; ++i) {
+        NN_CHECK_MSG(first[i] == again[i], "task %zu moved to another thread", i);
+        NN_CHECK_MSG(first[i] == first[i % 3], "task %zu not on worker %zu", i, i % 3);
+        NN_CHECK_MSG(first[i] != main_thread, "task %zu run by the waiting thread", i);
+    }
+
+    // a worker busy with a job leaves its tasks to the waiting thread
+    std::atomic<bool> release{false};
+    std::atomic<bool> job_started{false};
+    NNTaskGroup job;
+    pool.submit(job, [&] {
+        job_started = true;
+        hold(release);
+    });
+    while (!job_started) std::this_thread::yield();
+    std::atomic<size_t> done{0};
+    pool.runPinned(6, [&](size_t) { ++done; });
+    NN_CHECK_MSG(!job.done(), "waited for the busy worker");
+    NN_CHECK(done == 6);
+    release = true;
+    job.wait();
+}
+
+int main() {
+    waitOnlyForOwnGroup();
+    cancelQueuedJobs();
+    pinnedTasks();
+    return testResult();
+}